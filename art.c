@@ -0,0 +1,636 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "art.h"
+#include "bit.h"
+
+
+/* Helper returning the smaller of two ints. */
+static int art_min(int a, int b) {
+    return a < b ? a : b;
+}
+
+
+/* Allocates an empty inner node of the given layout. */
+static art_node_t *create_art_node(art_type_t type) {
+    size_t size = 0;
+    switch (type) {
+        case ART_NODE4:   size = sizeof(art_node4_t);   break;
+        case ART_NODE16:  size = sizeof(art_node16_t);  break;
+        case ART_NODE48:  size = sizeof(art_node48_t);  break;
+        case ART_NODE256: size = sizeof(art_node256_t); break;
+        default: assert(0);
+    }
+    art_node_t *node = (art_node_t *)calloc(1, size);
+    assert(node);
+    node->type = type;
+    return node;
+}
+
+
+/* Creates a leaf for key holding a single record. */
+static art_leaf_t *create_art_leaf(char *key, record_t *record) {
+    art_leaf_t *leaf = (art_leaf_t *)malloc(sizeof(*leaf));
+    assert(leaf);
+    leaf->type = ART_LEAF;
+    leaf->key = key;
+    leaf->key_len = strlen(key) + 1;
+    leaf->head = leaf->tail = NULL;
+
+    node_rec_t *node_rec = (node_rec_t *)malloc(sizeof(*node_rec));
+    assert(node_rec);
+    node_rec->rec = record;
+    node_rec->next = NULL;
+    leaf->head = leaf->tail = node_rec;
+    return leaf;
+}
+
+
+/* Appends a record to an existing leaf. */
+static void art_leaf_add_record(art_leaf_t *leaf, record_t *record) {
+    node_rec_t *node_rec = (node_rec_t *)malloc(sizeof(*node_rec));
+    assert(node_rec);
+    node_rec->rec = record;
+    node_rec->next = NULL;
+    leaf->tail = leaf->tail->next = node_rec;
+}
+
+
+/* Creates an empty adaptive radix tree. */
+art_tree_t *create_art_tree(void) {
+    art_tree_t *tree = (art_tree_t *)malloc(sizeof(*tree));
+    assert(tree);
+    tree->root = NULL;
+    tree->size = 0;
+    return tree;
+}
+
+
+/* Returns the child slot for key byte c, or NULL if there is none. */
+static art_node_t **find_child(art_node_t *node, unsigned char c) {
+    switch (node->type) {
+        case ART_NODE4: {
+            art_node4_t *p = (art_node4_t *)node;
+            for (int i = 0; i < node->num_children; i++) {
+                if (p->keys[i] == c) return &p->children[i];
+            }
+            return NULL;
+        }
+        case ART_NODE16: {
+            art_node16_t *p = (art_node16_t *)node;
+#ifdef __SSE2__
+            // compare the byte against all 16 keys at once
+            __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+                _mm_loadu_si128((__m128i *)p->keys));
+            int mask = (1 << node->num_children) - 1;
+            int bitfield = _mm_movemask_epi8(cmp) & mask;
+            if (bitfield) return &p->children[__builtin_ctz(bitfield)];
+#else
+            for (int i = 0; i < node->num_children; i++) {
+                if (p->keys[i] == c) return &p->children[i];
+            }
+#endif
+            return NULL;
+        }
+        case ART_NODE48: {
+            art_node48_t *p = (art_node48_t *)node;
+            int idx = p->child_index[c];
+            if (idx != ART_NODE48_EMPTY) return &p->children[idx - 1];
+            return NULL;
+        }
+        case ART_NODE256: {
+            art_node256_t *p = (art_node256_t *)node;
+            if (p->children[c]) return &p->children[c];
+            return NULL;
+        }
+        default:
+            return NULL;
+    }
+}
+
+
+/* Returns the leftmost leaf below node, used to recover long prefixes. */
+static art_leaf_t *minimum_leaf(art_node_t *node) {
+    while (node && node->type != ART_LEAF) {
+        switch (node->type) {
+            case ART_NODE4:
+                node = ((art_node4_t *)node)->children[0];
+                break;
+            case ART_NODE16:
+                node = ((art_node16_t *)node)->children[0];
+                break;
+            case ART_NODE48: {
+                art_node48_t *p = (art_node48_t *)node;
+                int c = 0;
+                while (p->child_index[c] == ART_NODE48_EMPTY) c++;
+                node = p->children[p->child_index[c] - 1];
+                break;
+            }
+            case ART_NODE256: {
+                art_node256_t *p = (art_node256_t *)node;
+                int c = 0;
+                while (!p->children[c]) c++;
+                node = p->children[c];
+                break;
+            }
+        }
+    }
+    return (art_leaf_t *)node;
+}
+
+
+/* Copies a node's header (compressed path) into a grown replacement. */
+static void copy_header(art_node_t *dest, art_node_t *src) {
+    dest->num_children = src->num_children;
+    dest->prefix_len = src->prefix_len;
+    memcpy(dest->prefix, src->prefix,
+        art_min(ART_MAX_PREFIX_LEN, src->prefix_len));
+}
+
+
+/* Adds child to a node256. */
+static void add_child256(art_node256_t *node, unsigned char c, art_node_t *child) {
+    node->n.num_children++;
+    node->children[c] = child;
+}
+
+
+/* Adds child to a node48, growing to node256 when full. */
+static void add_child48(art_node48_t *node, art_node_t **ref, unsigned char c,
+        art_node_t *child) {
+    if (node->n.num_children < 48) {
+        int pos = 0;
+        while (node->children[pos]) pos++;
+        node->children[pos] = child;
+        node->child_index[c] = pos + 1;
+        node->n.num_children++;
+        return;
+    }
+
+    art_node256_t *grown = (art_node256_t *)create_art_node(ART_NODE256);
+    for (int i = 0; i < 256; i++) {
+        if (node->child_index[i] != ART_NODE48_EMPTY) {
+            grown->children[i] = node->children[node->child_index[i] - 1];
+        }
+    }
+    copy_header(&grown->n, &node->n);
+    *ref = (art_node_t *)grown;
+    free(node);
+    add_child256(grown, c, child);
+}
+
+
+/* Adds child to a node16 keeping keys sorted, growing to node48 when full. */
+static void add_child16(art_node16_t *node, art_node_t **ref, unsigned char c,
+        art_node_t *child) {
+    if (node->n.num_children < 16) {
+        int pos = 0;
+        while (pos < node->n.num_children && node->keys[pos] < c) pos++;
+        memmove(node->keys + pos + 1, node->keys + pos,
+            node->n.num_children - pos);
+        memmove(node->children + pos + 1, node->children + pos,
+            (node->n.num_children - pos) * sizeof(art_node_t *));
+        node->keys[pos] = c;
+        node->children[pos] = child;
+        node->n.num_children++;
+        return;
+    }
+
+    art_node48_t *grown = (art_node48_t *)create_art_node(ART_NODE48);
+    memcpy(grown->children, node->children,
+        node->n.num_children * sizeof(art_node_t *));
+    for (int i = 0; i < node->n.num_children; i++) {
+        grown->child_index[node->keys[i]] = i + 1;
+    }
+    copy_header(&grown->n, &node->n);
+    *ref = (art_node_t *)grown;
+    free(node);
+    add_child48(grown, ref, c, child);
+}
+
+
+/* Adds child to a node4 keeping keys sorted, growing to node16 when full. */
+static void add_child4(art_node4_t *node, art_node_t **ref, unsigned char c,
+        art_node_t *child) {
+    if (node->n.num_children < 4) {
+        int pos = 0;
+        while (pos < node->n.num_children && node->keys[pos] < c) pos++;
+        memmove(node->keys + pos + 1, node->keys + pos,
+            node->n.num_children - pos);
+        memmove(node->children + pos + 1, node->children + pos,
+            (node->n.num_children - pos) * sizeof(art_node_t *));
+        node->keys[pos] = c;
+        node->children[pos] = child;
+        node->n.num_children++;
+        return;
+    }
+
+    art_node16_t *grown = (art_node16_t *)create_art_node(ART_NODE16);
+    memcpy(grown->children, node->children,
+        node->n.num_children * sizeof(art_node_t *));
+    memcpy(grown->keys, node->keys, node->n.num_children);
+    copy_header(&grown->n, &node->n);
+    *ref = (art_node_t *)grown;
+    free(node);
+    add_child16(grown, ref, c, child);
+}
+
+
+/* Adds child under key byte c, replacing *ref if the node has to grow. */
+static void add_child(art_node_t *node, art_node_t **ref, unsigned char c,
+        art_node_t *child) {
+    switch (node->type) {
+        case ART_NODE4:
+            add_child4((art_node4_t *)node, ref, c, child);
+            break;
+        case ART_NODE16:
+            add_child16((art_node16_t *)node, ref, c, child);
+            break;
+        case ART_NODE48:
+            add_child48((art_node48_t *)node, ref, c, child);
+            break;
+        case ART_NODE256:
+            add_child256((art_node256_t *)node, c, child);
+            break;
+    }
+}
+
+
+/* Returns the index of the first byte where key differs from the node's
+ * compressed path starting at depth, or the path length if all match.
+ */
+static int prefix_mismatch(art_node_t *node, char *key, int key_len, int depth) {
+    unsigned char *k = (unsigned char *)key;
+    int max_cmp = art_min(art_min(ART_MAX_PREFIX_LEN, node->prefix_len),
+        key_len - depth);
+    int idx;
+    for (idx = 0; idx < max_cmp; idx++) {
+        if (node->prefix[idx] != k[depth + idx]) return idx;
+    }
+
+    // path longer than the inline bytes, compare the rest against a leaf
+    if (node->prefix_len > ART_MAX_PREFIX_LEN) {
+        art_leaf_t *leaf = minimum_leaf(node);
+        max_cmp = art_min(art_min(leaf->key_len, key_len) - depth,
+            node->prefix_len);
+        for (; idx < max_cmp; idx++) {
+            if ((unsigned char)leaf->key[depth + idx] != k[depth + idx]) {
+                return idx;
+            }
+        }
+    }
+    return idx;
+}
+
+
+/* Inserts record under key below node, splitting leaves or paths on mismatch. */
+static void recursive_art_insert(art_tree_t *tree, art_node_t *node,
+        art_node_t **ref, char *key, int key_len, int depth, record_t *record) {
+
+    // empty slot, store the new leaf
+    if (!node) {
+        *ref = (art_node_t *)create_art_leaf(key, record);
+        tree->size++;
+        return;
+    }
+
+    if (node->type == ART_LEAF) {
+        art_leaf_t *leaf = (art_leaf_t *)node;
+        if (leaf->key_len == key_len && memcmp(leaf->key, key, key_len) == 0) {
+            // same key, append record
+            art_leaf_add_record(leaf, record);
+            return;
+        }
+
+        // split the leaf into a node4 over the common bytes
+        art_node4_t *parent = (art_node4_t *)create_art_node(ART_NODE4);
+        art_leaf_t *new_leaf = create_art_leaf(key, record);
+        tree->size++;
+
+        int limit = art_min(leaf->key_len, key_len);
+        int common = 0;
+        while (depth + common < limit
+                && leaf->key[depth + common] == key[depth + common]) {
+            common++;
+        }
+        parent->n.prefix_len = common;
+        memcpy(parent->n.prefix, key + depth, art_min(ART_MAX_PREFIX_LEN, common));
+
+        *ref = (art_node_t *)parent;
+        add_child4(parent, ref, leaf->key[depth + common], node);
+        add_child4(parent, ref, key[depth + common], (art_node_t *)new_leaf);
+        return;
+    }
+
+    if (node->prefix_len) {
+        int diff = prefix_mismatch(node, key, key_len, depth);
+        if (diff < (int)node->prefix_len) {
+            // split the compressed path where the key diverges
+            art_node4_t *parent = (art_node4_t *)create_art_node(ART_NODE4);
+            *ref = (art_node_t *)parent;
+            parent->n.prefix_len = diff;
+            memcpy(parent->n.prefix, node->prefix, art_min(ART_MAX_PREFIX_LEN, diff));
+
+            if (node->prefix_len <= ART_MAX_PREFIX_LEN) {
+                add_child4(parent, ref, node->prefix[diff], node);
+                node->prefix_len -= diff + 1;
+                memmove(node->prefix, node->prefix + diff + 1,
+                    art_min(ART_MAX_PREFIX_LEN, node->prefix_len));
+            } else {
+                node->prefix_len -= diff + 1;
+                art_leaf_t *leaf = minimum_leaf(node);
+                add_child4(parent, ref, leaf->key[depth + diff], node);
+                memcpy(node->prefix, leaf->key + depth + diff + 1,
+                    art_min(ART_MAX_PREFIX_LEN, node->prefix_len));
+            }
+
+            art_leaf_t *new_leaf = create_art_leaf(key, record);
+            tree->size++;
+            add_child4(parent, ref, key[depth + diff], (art_node_t *)new_leaf);
+            return;
+        }
+        depth += node->prefix_len;
+    }
+
+    // continue down the matching child or add a new one
+    art_node_t **child = find_child(node, key[depth]);
+    if (child) {
+        recursive_art_insert(tree, *child, child, key, key_len, depth + 1, record);
+        return;
+    }
+    art_leaf_t *new_leaf = create_art_leaf(key, record);
+    tree->size++;
+    add_child(node, ref, key[depth], (art_node_t *)new_leaf);
+}
+
+
+/* Inserts a record under key, appending to the leaf if the key exists. */
+void art_insert(art_tree_t *tree, char *key, record_t *record) {
+    recursive_art_insert(tree, tree->root, &tree->root, key,
+        strlen(key) + 1, START_BIT, record);
+}
+
+
+/* Searches for exact key byte by byte and records the node where the
+ * descent stopped for closest-match search.
+ */
+art_leaf_t *art_exact_search(art_tree_t *tree, char *key, result_t *result,
+        art_node_t **mismatch_node) {
+
+    *mismatch_node = NULL;
+    if (!tree || !tree->root) return NULL;
+
+    int key_len = strlen(key) + 1;
+    int depth = 0;
+    art_node_t *node = tree->root;
+
+    while (node) {
+        result->node_cmps++;
+        *mismatch_node = node;
+
+        if (node->type == ART_LEAF) {
+            art_leaf_t *leaf = (art_leaf_t *)node;
+            // compare the remaining bytes of the key against the leaf
+            int i = depth;
+            while (i < key_len && i < leaf->key_len && leaf->key[i] == key[i]) i++;
+            result->bit_cmps += (i - depth + MISMATCH_BIT) * BITS_PER_BYTE;
+            if (i < key_len || leaf->key_len != key_len) return NULL;
+
+            result->bit_cmps -= MISMATCH_BIT * BITS_PER_BYTE;
+            result->str_cmps++;
+            for (node_rec_t *nrec = leaf->head; nrec; nrec = nrec->next) {
+                result->matches[result->match_count++] = nrec->rec;
+            }
+            return leaf;
+        }
+
+        // compare the compressed path
+        if (node->prefix_len) {
+            int diff = prefix_mismatch(node, key, key_len, depth);
+            if (diff < (int)node->prefix_len) {
+                result->bit_cmps += (diff + MISMATCH_BIT) * BITS_PER_BYTE;
+                return NULL;
+            }
+            result->bit_cmps += node->prefix_len * BITS_PER_BYTE;
+            depth += node->prefix_len;
+        }
+
+        // branch on the next key byte
+        result->bit_cmps += BITS_PER_BYTE;
+        art_node_t **child = find_child(node, key[depth]);
+        if (!child) return NULL;
+        node = *child;
+        depth++;
+    }
+    return NULL;
+}
+
+
+/* Post traversal helper to collect all descendant records in key order. */
+void art_collect_subtree_records(art_node_t *node, result_t *result) {
+    if (!node) return;
+    // keep what was gathered once a time budget runs out
+    if (result->match_count && result_out_of_time(result)) return;
+
+    switch (node->type) {
+        case ART_LEAF: {
+            art_leaf_t *leaf = (art_leaf_t *)node;
+            for (node_rec_t *nrec = leaf->head; nrec; nrec = nrec->next) {
+                result->matches[result->match_count++] = nrec->rec;
+            }
+            break;
+        }
+        case ART_NODE4: {
+            art_node4_t *p = (art_node4_t *)node;
+            for (int i = 0; i < node->num_children; i++) {
+                art_collect_subtree_records(p->children[i], result);
+            }
+            break;
+        }
+        case ART_NODE16: {
+            art_node16_t *p = (art_node16_t *)node;
+            for (int i = 0; i < node->num_children; i++) {
+                art_collect_subtree_records(p->children[i], result);
+            }
+            break;
+        }
+        case ART_NODE48: {
+            art_node48_t *p = (art_node48_t *)node;
+            for (int c = 0; c < 256; c++) {
+                if (p->child_index[c] != ART_NODE48_EMPTY) {
+                    art_collect_subtree_records(p->children[p->child_index[c] - 1],
+                        result);
+                }
+            }
+            break;
+        }
+        case ART_NODE256: {
+            art_node256_t *p = (art_node256_t *)node;
+            for (int c = 0; c < 256; c++) {
+                art_collect_subtree_records(p->children[c], result);
+            }
+            break;
+        }
+    }
+}
+
+
+/* Does closest-match search to find nearest key after mismatch. */
+void art_search_closest(art_node_t *last_match, char *key, result_t *result) {
+    if (!last_match) return;
+
+    int init_count = result->match_count;
+    art_collect_subtree_records(last_match, result);
+    select_closest(result, key, init_count);
+}
+
+
+/* Collects records of every key starting with prefix in key order. */
+void art_prefix_search(art_tree_t *tree, char *prefix, result_t *result) {
+    if (!tree) return;
+    int prefix_len = strlen(prefix);
+    int depth = 0;
+    art_node_t *node = tree->root;
+
+    while (node) {
+        result->node_cmps++;
+
+        // prefix fully consumed, everything below matches
+        if (depth >= prefix_len) break;
+
+        if (node->type == ART_LEAF) {
+            art_leaf_t *leaf = (art_leaf_t *)node;
+            result->bit_cmps += (prefix_len - depth) * BITS_PER_BYTE;
+            if (leaf->key_len <= prefix_len
+                    || memcmp(leaf->key + depth, prefix + depth, prefix_len - depth)) {
+                return;
+            }
+            break;
+        }
+
+        if (node->prefix_len) {
+            int diff = prefix_mismatch(node, prefix, prefix_len, depth);
+            result->bit_cmps += diff * BITS_PER_BYTE;
+            if (depth + diff >= prefix_len) break;
+            if (diff < (int)node->prefix_len) return;
+            depth += node->prefix_len;
+            if (depth >= prefix_len) break;
+        }
+
+        result->bit_cmps += BITS_PER_BYTE;
+        art_node_t **child = find_child(node, prefix[depth]);
+        if (!child) return;
+        node = *child;
+        depth++;
+    }
+    art_collect_subtree_records(node, result);
+}
+
+
+/* Helper adding a subtree's memory use to stats. */
+static void art_node_memory_stats(art_node_t *node, tree_mem_stats_t *stats) {
+    if (!node) return;
+    stats->node_count++;
+
+    switch (node->type) {
+        case ART_LEAF: {
+            art_leaf_t *leaf = (art_leaf_t *)node;
+            stats->node_bytes += sizeof(*leaf);
+            for (node_rec_t *nrec = leaf->head; nrec; nrec = nrec->next) {
+                stats->link_bytes += sizeof(*nrec);
+                stats->record_count++;
+                stats->field_bytes += record_memory_bytes(nrec->rec);
+            }
+            return;
+        }
+        case ART_NODE4: {
+            art_node4_t *p = (art_node4_t *)node;
+            stats->node_bytes += sizeof(*p);
+            for (int i = 0; i < node->num_children; i++) {
+                art_node_memory_stats(p->children[i], stats);
+            }
+            return;
+        }
+        case ART_NODE16: {
+            art_node16_t *p = (art_node16_t *)node;
+            stats->node_bytes += sizeof(*p);
+            for (int i = 0; i < node->num_children; i++) {
+                art_node_memory_stats(p->children[i], stats);
+            }
+            return;
+        }
+        case ART_NODE48: {
+            art_node48_t *p = (art_node48_t *)node;
+            stats->node_bytes += sizeof(*p);
+            for (int i = 0; i < 48; i++) art_node_memory_stats(p->children[i], stats);
+            return;
+        }
+        case ART_NODE256: {
+            art_node256_t *p = (art_node256_t *)node;
+            stats->node_bytes += sizeof(*p);
+            for (int c = 0; c < 256; c++) art_node_memory_stats(p->children[c], stats);
+            return;
+        }
+    }
+}
+
+
+/* Adds the tree's memory use to stats. */
+void art_memory_stats(art_tree_t *tree, tree_mem_stats_t *stats) {
+    if (!tree) return;
+    stats->node_bytes += sizeof(*tree);
+    art_node_memory_stats(tree->root, stats);
+}
+
+
+/* Frees a subtree recursively, including the records held by leaves. */
+static void free_art_node(art_node_t *node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case ART_LEAF: {
+            art_leaf_t *leaf = (art_leaf_t *)node;
+            node_rec_t *curr = leaf->head;
+            while (curr) {
+                node_rec_t *tmp = curr->next;
+                free_record(curr->rec);
+                free(curr);
+                curr = tmp;
+            }
+            break;
+        }
+        case ART_NODE4: {
+            art_node4_t *p = (art_node4_t *)node;
+            for (int i = 0; i < node->num_children; i++) free_art_node(p->children[i]);
+            break;
+        }
+        case ART_NODE16: {
+            art_node16_t *p = (art_node16_t *)node;
+            for (int i = 0; i < node->num_children; i++) free_art_node(p->children[i]);
+            break;
+        }
+        case ART_NODE48: {
+            art_node48_t *p = (art_node48_t *)node;
+            for (int i = 0; i < 48; i++) free_art_node(p->children[i]);
+            break;
+        }
+        case ART_NODE256: {
+            art_node256_t *p = (art_node256_t *)node;
+            for (int c = 0; c < 256; c++) free_art_node(p->children[c]);
+            break;
+        }
+    }
+    free(node);
+}
+
+
+/* Frees the tree, its nodes and all stored records. */
+void free_art_tree(art_tree_t *tree) {
+    if (!tree) return;
+    free_art_node(tree->root);
+    free(tree);
+}
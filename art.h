@@ -0,0 +1,99 @@
+#ifndef _ART_H_
+#define _ART_H_
+#include <stdint.h>
+#include "tree.h"
+#include "record.h"
+#include "result.h"
+
+
+#define ART_MAX_PREFIX_LEN 10 // compressed path bytes stored inline per node
+#define ART_NODE48_EMPTY 0    // node48 key slot with no child
+
+
+// Node layouts for the adaptive radix tree, grown as fan-out increases.
+typedef enum {
+    ART_LEAF,
+    ART_NODE4,
+    ART_NODE16,
+    ART_NODE48,
+    ART_NODE256
+} art_type_t;
+
+typedef struct art_node art_node_t;
+typedef struct art_tree art_tree_t;
+
+// common header of every inner node (leaves only share the type byte)
+struct art_node {
+    uint8_t type;
+    uint16_t num_children;
+    uint32_t prefix_len; // full compressed path length, may exceed inline bytes
+    unsigned char prefix[ART_MAX_PREFIX_LEN];
+};
+
+typedef struct {
+    art_node_t n;
+    unsigned char keys[4]; // sorted
+    art_node_t *children[4];
+} art_node4_t;
+
+typedef struct {
+    art_node_t n;
+    unsigned char keys[16]; // sorted, searched 16 bytes at a time
+    art_node_t *children[16];
+} art_node16_t;
+
+typedef struct {
+    art_node_t n;
+    unsigned char child_index[256]; // key byte -> children slot + 1
+    art_node_t *children[48];
+} art_node48_t;
+
+typedef struct {
+    art_node_t n;
+    art_node_t *children[256];
+} art_node256_t;
+
+// leaf holds one distinct key and all of its records
+typedef struct {
+    uint8_t type;
+    int key_len;   // includes the terminating '\0'
+    char *key;     // borrowed from the first record inserted
+    node_rec_t *head;
+    node_rec_t *tail;
+} art_leaf_t;
+
+struct art_tree {
+    art_node_t *root;
+    size_t size;
+};
+
+
+/* Creates an empty adaptive radix tree. */
+art_tree_t *create_art_tree(void);
+
+/* Inserts a record under key, appending to the leaf if the key exists. */
+void art_insert(art_tree_t *tree, char *key, record_t *record);
+
+/* Searches for exact key byte by byte and records the node where the
+ * descent stopped for closest-match search.
+ */
+art_leaf_t *art_exact_search(art_tree_t *tree, char *key, result_t *result,
+    art_node_t **mismatch_node);
+
+/* Post traversal helper to collect all descendant records in key order. */
+void art_collect_subtree_records(art_node_t *node, result_t *result);
+
+/* Does closest-match search to find nearest key after mismatch. */
+void art_search_closest(art_node_t *last_match, char *key, result_t *result);
+
+/* Collects records of every key starting with prefix in key order. */
+void art_prefix_search(art_tree_t *tree, char *prefix, result_t *result);
+
+/* Adds the tree's memory use to stats. */
+void art_memory_stats(art_tree_t *tree, tree_mem_stats_t *stats);
+
+/* Frees the tree, its nodes and all stored records. */
+void free_art_tree(art_tree_t *tree);
+
+
+#endif
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "batch.h"
+#include "bit.h"
+#include "exact_hash.h"
+#include "token_index.h"
+
+
+/* Helper qsort comparator ordering query pointers by key. */
+static int compare_queries(const void *a, const void *b) {
+    return strcmp((*(batch_query_t **)a)->key, (*(batch_query_t **)b)->key);
+}
+
+
+/* Returns how many leading bits two keys share, counting the terminating
+ * '\0', so identical keys share all of their bits.
+ */
+static int common_bits(char *a, char *b) {
+    int byte = 0;
+    while (a[byte] && a[byte] == b[byte]) byte++;
+    if (a[byte] == b[byte]) return (byte + 1) * BITS_PER_BYTE;
+
+    int bits = byte * BITS_PER_BYTE;
+    unsigned char diff = (unsigned char)(a[byte] ^ b[byte]);
+    while (!(diff & 0x80)) {
+        diff <<= 1;
+        bits++;
+    }
+    return bits;
+}
+
+
+/* Records where a query's descent stopped. */
+static void finish_query(batch_query_t *query, tree_node_t *node, int exact,
+        int bit_cmps, int node_cmps) {
+    query->end_node = node;
+    query->exact = exact;
+    query->bit_cmps = bit_cmps;
+    query->node_cmps = node_cmps;
+}
+
+
+/* Walks the sorted queries q[lo..hi) down from node. Every query of the
+ * group reached node by the same path, so they share curr_bit, the
+ * counters so far and the last matched node. Queries that continue past
+ * node stay sorted, so those going left and right form two runs.
+ */
+static void batch_descend(tree_node_t *node, batch_query_t **q, int lo, int hi,
+        int curr_bit, int bit_cmps, int node_cmps, tree_node_t *last_node) {
+    if (!node) {
+        for (int i = lo; i < hi; i++) {
+            finish_query(q[i], last_node, 0, bit_cmps, node_cmps);
+        }
+        return;
+    }
+
+    node_cmps++;
+    int next_bit = curr_bit + node->prefix_bits;
+    int runs[2][2] = { { -1, -1 }, { -1, -1 } }; // [side][first, end]
+    int prev_match = -1;
+
+    for (int i = lo; i < hi; i++) {
+        batch_query_t *query = q[i];
+
+        // a neighbour that agrees up to and past the previous query's
+        // first mismatching bit (or the whole prefix) matches as many bits
+        int match;
+        int needed = curr_bit + prev_match + (prev_match < node->prefix_bits);
+        if (prev_match >= 0 && query->lcp_bits >= needed) {
+            match = prev_match;
+        } else {
+            match = compare_prefix_bits(query->key, curr_bit, query->total_bits,
+                node->prefix, node->prefix_bits);
+        }
+        prev_match = match;
+
+        if (match < node->prefix_bits) {
+            finish_query(query, node, 0, bit_cmps + match + MISMATCH_BIT, node_cmps);
+            continue;
+        }
+        if (next_bit >= query->total_bits) {
+            finish_query(query, node, 1, bit_cmps + match, node_cmps);
+            continue;
+        }
+
+        int side = getBit(query->key, next_bit);
+        if (runs[side][0] < 0) runs[side][0] = i;
+        assert(runs[side][1] < 0 || runs[side][1] == i);
+        runs[side][1] = i + 1;
+    }
+
+    if (runs[0][0] >= 0) {
+        batch_descend(node->left, q, runs[0][0], runs[0][1], next_bit,
+            bit_cmps + node->prefix_bits, node_cmps, node);
+    }
+    if (runs[1][0] >= 0) {
+        batch_descend(node->right, q, runs[1][0], runs[1][1], next_bit,
+            bit_cmps + node->prefix_bits, node_cmps, node);
+    }
+}
+
+
+/* Descends the Patricia tree once for a whole batch of queries. Queries are
+ * sorted internally and walked as groups that share the path so far, so
+ * each node is visited once per group rather than once per query. A
+ * neighbour's prefix comparison is reused when the two keys agree past
+ * the bits it compared. Queries found in the exact hash are not descended.
+ * Only an unsharded Patricia tree can be batched.
+ */
+void batch_search(tree_dict_t *dict, batch_query_t *queries, int count) {
+    assert(dict->index_type == INDEX_PATRICIA && !dict->num_shards);
+    int descending = 0;
+    for (int i = 0; i < count; i++) {
+        queries[i].total_bits = get_total_bits(queries[i].key);
+        // the probe is kept so batch_result answers a hit without another
+        queries[i].hit = dict->exact
+            ? exact_hash_find(dict->exact, queries[i].key) : NULL;
+        descending += !queries[i].hit;
+        finish_query(&queries[i], NULL, 0, 0, 0);
+    }
+    if (!descending) return;
+
+    // sort pointers so the caller's order is kept
+    batch_query_t **sorted = (batch_query_t **)malloc(descending * sizeof(*sorted));
+    assert(sorted);
+    for (int i = 0, n = 0; i < count; i++) {
+        if (!queries[i].hit) sorted[n++] = &queries[i];
+    }
+    qsort(sorted, descending, sizeof(*sorted), compare_queries);
+    sorted[0]->lcp_bits = 0;
+    for (int i = 1; i < descending; i++) {
+        sorted[i]->lcp_bits = common_bits(sorted[i - 1]->key, sorted[i]->key);
+    }
+
+    batch_descend(dict->root, sorted, 0, descending, START_BIT, 0, 0, NULL);
+    free(sorted);
+}
+
+
+/* Fills one query's result after batch_search: exact match records or the
+ * closest match, from the same sources and with the same counters as
+ * dict_search.
+ */
+void batch_result(tree_dict_t *dict, batch_query_t *query, result_t *result) {
+    if (query->hit) {
+        exact_hash_append(dict->exact, query->hit, query->key, result);
+        return;
+    }
+    int init_count = result->match_count;
+    result->bit_cmps += query->bit_cmps;
+    result->node_cmps += query->node_cmps;
+    if (query->exact) {
+        result->str_cmps++;
+        for (node_rec_t *nrec = query->end_node->head; nrec; nrec = nrec->next) {
+            result->matches[result->match_count++] = nrec->rec;
+        }
+        return;
+    }
+    if (query->end_node) search_closest(query->end_node, query->key, result);
+
+    // as in dict_search the token index widens the tree's closest match
+    if (dict->tokens) {
+        token_index_search(dict->tokens, query->key, result, init_count);
+    }
+}
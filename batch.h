@@ -0,0 +1,40 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+#include "tree.h"
+#include "result.h"
+#include "exact_hash.h"
+
+
+#define MAX_BATCH 65536 // upper bound for --batch
+
+
+// type definition for one query of a sorted batch and where its descent ended
+typedef struct {
+    char *key;
+    int total_bits;
+    int lcp_bits;  // leading bits shared with the previous query in sorted order
+    int bit_cmps;
+    int node_cmps;
+    tree_node_t *end_node; // node holding the exact match, else the last node
+    int exact;     // 1 if end_node holds the key itself
+    exact_entry_t *hit; // exact hash entry found instead of descending, or NULL
+} batch_query_t;
+
+
+/* Descends the Patricia tree once for a whole batch of queries. Queries are
+ * sorted internally and walked as groups that share the path so far, so
+ * each node is visited once per group rather than once per query. A
+ * neighbour's prefix comparison is reused when the two keys agree past
+ * the bits it compared. Queries found in the exact hash are not descended.
+ * Only an unsharded Patricia tree can be batched.
+ */
+void batch_search(tree_dict_t *dict, batch_query_t *queries, int count);
+
+/* Fills one query's result after batch_search: exact match records or the
+ * closest match, from the same sources and with the same counters as
+ * dict_search.
+ */
+void batch_result(tree_dict_t *dict, batch_query_t *query, result_t *result);
+
+
+#endif
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "protocol.h"
+#include "record.h"
+#include "csv.h"
+
+
+#define CLIENT_DEFAULT_DEPTH 32 // requests kept in flight
+
+
+int send_query(int fd, uint8_t op, uint32_t id, char *key);
+char *read_response(int fd, response_head_t *head);
+char *decode_record(char *p, char *fields[NUM_FIELDS]);
+void print_response(FILE *out_fp, char *query, char *body, response_head_t *head,
+    char *headers[NUM_FIELDS]);
+
+
+/* Local client for the lookup server. Reads queries from stdin, keeps up to
+ * --depth requests pipelined and writes results in the same formats as
+ * dict2: records to output_file and one summary line per query to stdout.
+ * Usage: dict2_client <socket> <output_file> [--op=exact|closest|prefix]
+ *        [--depth=N]
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        return 1;
+    }
+    uint8_t op = OP_CLOSEST;
+    int depth = CLIENT_DEFAULT_DEPTH;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--op=exact") == 0) {
+            op = OP_EXACT;
+        } else if (strcmp(argv[i], "--op=closest") == 0) {
+            op = OP_CLOSEST;
+        } else if (strcmp(argv[i], "--op=prefix") == 0) {
+            op = OP_PREFIX;
+        } else if (strncmp(argv[i], "--depth=", 8) == 0 && atoi(argv[i] + 8) > 0) {
+            depth = atoi(argv[i] + 8);
+        } else {
+            return 1;
+        }
+    }
+
+    int fd = proto_connect(argv[1]);
+    if (fd < 0) { return 1; }
+    FILE *out_fp = fopen(argv[2], "w");
+    if (!out_fp) { close(fd); return 1; }
+
+    // fetch header names once for printing records
+    response_head_t head;
+    char *header_body = NULL;
+    char *headers[NUM_FIELDS];
+    if (!send_query(fd, OP_HEADERS, 0, "")
+            || !(header_body = read_response(fd, &head))) {
+        fclose(out_fp);
+        close(fd);
+        return 1;
+    }
+    decode_record(header_body + PROTO_RESPONSE_FIXED, headers);
+
+    // queries awaiting a response, in send order
+    char **pending = (char **)malloc(depth * sizeof(*pending));
+    assert(pending);
+    int first = 0, in_flight = 0, more = 1, ok = 1;
+    uint32_t next_id = 1;
+    char line[MAX_LINE_LEN];
+
+    while (ok) {
+        // top up the pipeline
+        while (more && in_flight < depth) {
+            if (!fgets(line, sizeof(line), stdin)) {
+                more = 0;
+                break;
+            }
+            remove_newline(line);
+            if (line[0] == '\0') continue;
+            if (!send_query(fd, op, next_id++, line)) {
+                ok = 0;
+                break;
+            }
+            pending[(first + in_flight++) % depth] = strdup(line);
+        }
+        if (!ok || in_flight == 0) break;
+
+        // responses come back in order
+        char *body = read_response(fd, &head);
+        if (!body) break;
+        char *query = pending[first];
+        print_response(out_fp, query, body, &head, headers);
+        free(query);
+        free(body);
+        first = (first + 1) % depth;
+        in_flight--;
+    }
+
+    for (int i = 0; i < in_flight; i++) {
+        free(pending[(first + i) % depth]);
+    }
+    free(pending);
+    free(header_body);
+    fclose(out_fp);
+    close(fd);
+    return in_flight ? 1 : 0;
+}
+
+
+/* Sends one request frame. Returns 0 on error. */
+int send_query(int fd, uint8_t op, uint32_t id, char *key) {
+    buffer_t buf;
+    buffer_init(&buf);
+    proto_put_request(&buf, op, id, key);
+    int ok = proto_write_all(fd, buf.data, buf.len);
+    buffer_free(&buf);
+    return ok;
+}
+
+
+/* Reads one response frame, returns its body (caller frees) or NULL. */
+char *read_response(int fd, response_head_t *head) {
+    char len_bytes[PROTO_LEN_BYTES];
+    if (!proto_read_exact(fd, len_bytes, sizeof(len_bytes))) return NULL;
+    uint32_t len = get_u32(len_bytes);
+    if (len < PROTO_RESPONSE_FIXED || len > PROTO_MAX_RESPONSE) return NULL;
+
+    char *body = (char *)malloc(len);
+    assert(body);
+    if (!proto_read_exact(fd, body, len)) {
+        free(body);
+        return NULL;
+    }
+    proto_get_response_head(body, head);
+    return body;
+}
+
+
+/* Splits one encoded record in place into NUL-terminated fields.
+ * Returns the position just after the record.
+ */
+char *decode_record(char *p, char *fields[NUM_FIELDS]) {
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        uint16_t len = get_u16(p);
+        // shift the bytes over the length prefix to make room for '\0'
+        memmove(p, p + 2, len);
+        p[len] = '\0';
+        fields[i] = p;
+        p += len + 2;
+    }
+    return p;
+}
+
+
+/* Helper to format a response like dict2's output file and stdout. */
+void print_response(FILE *out_fp, char *query, char *body, response_head_t *head,
+        char *headers[NUM_FIELDS]) {
+    fprintf(out_fp, "%s\n", query);
+    if (head->count == 0) {
+        fputs("NOTFOUND\n", out_fp);
+    }
+
+    char *p = body + PROTO_RESPONSE_FIXED;
+    for (uint32_t i = 0; i < head->count; i++) {
+        char *fields[NUM_FIELDS];
+        p = decode_record(p, fields);
+        print_fields(out_fp, fields, headers);
+    }
+
+    printf("%s --> %u records found - comparisons: b%u n%u s%u%s\n",
+        query, head->count, head->bit_cmps, head->node_cmps, head->str_cmps,
+        head->status == STATUS_APPROXIMATE ? " - approximate" : "");
+}
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "compact.h"
+#include "bit.h"
+
+
+/* Helper to count nodes and records of a pointer subtree. */
+static void count_subtree(tree_node_t *node, uint32_t *nodes, uint32_t *records) {
+    if (!node) return;
+    (*nodes)++;
+    for (node_rec_t *nrec = node->head; nrec; nrec = nrec->next) {
+        (*records)++;
+    }
+    count_subtree(node->left, nodes, records);
+    count_subtree(node->right, nodes, records);
+}
+
+
+/* Helper returning the bytes needed to hold prefix_bits. */
+static size_t prefix_size(uint32_t prefix_bits) {
+    return (prefix_bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+}
+
+
+/* Returns a compact node's prefix, inline or from the arena. */
+static char *node_prefix(compact_tree_t *tree, compact_node_t *node) {
+    if (prefix_size(node->prefix_bits) <= COMPACT_INLINE_BYTES) {
+        return node->prefix.bytes;
+    }
+    return tree->prefixes + node->prefix.offset;
+}
+
+
+/* Copies one pointer node (and its subtree) into the arrays in preorder,
+ * freeing the pointer node and its record links on the way.
+ */
+static uint32_t freeze_node(compact_tree_t *tree, tree_node_t *node,
+        size_t *arena_cap) {
+    if (!node) return COMPACT_NONE;
+
+    uint32_t idx = tree->node_count++;
+    compact_node_t *cnode = &tree->nodes[idx];
+    cnode->prefix_bits = node->prefix_bits;
+
+    // store prefix inline when short, otherwise append to the arena
+    size_t bytes = prefix_size(node->prefix_bits);
+    memset(cnode->prefix.bytes, 0, COMPACT_INLINE_BYTES);
+    if (bytes <= COMPACT_INLINE_BYTES) {
+        memcpy(cnode->prefix.bytes, node->prefix, bytes);
+    } else {
+        if (tree->prefix_bytes + bytes > *arena_cap) {
+            while (tree->prefix_bytes + bytes > *arena_cap) *arena_cap *= 2;
+            tree->prefixes = (char *)realloc(tree->prefixes, *arena_cap);
+            assert(tree->prefixes);
+        }
+        cnode->prefix.offset = tree->prefix_bytes;
+        memcpy(tree->prefixes + tree->prefix_bytes, node->prefix, bytes);
+        tree->prefix_bytes += bytes;
+    }
+
+    // move own records into the flat array
+    cnode->rec_first = tree->record_count;
+    node_rec_t *curr = node->head;
+    while (curr) {
+        node_rec_t *tmp = curr->next;
+        tree->records[tree->record_count++] = curr->rec;
+        free(curr);
+        curr = tmp;
+    }
+    cnode->rec_end = tree->record_count;
+
+    tree_node_t *left = node->left, *right = node->right;
+    free(node->prefix);
+    free(node);
+
+    // nodes array is sized up front, so cnode stays valid while recursing
+    cnode->left = freeze_node(tree, left, arena_cap);
+    cnode->right = freeze_node(tree, right, arena_cap);
+    cnode->subtree_end = tree->record_count;
+    return idx;
+}
+
+
+/* Freezes a Patricia tree into the compact layout. Node memory of the
+ * pointer tree is released, its records move into the compact tree.
+ */
+compact_tree_t *compact_tree_build(tree_node_t *root) {
+    compact_tree_t *tree = (compact_tree_t *)malloc(sizeof(*tree));
+    assert(tree);
+
+    uint32_t nodes = 0, records = 0;
+    count_subtree(root, &nodes, &records);
+
+    tree->nodes = (compact_node_t *)malloc((nodes + 1) * sizeof(*tree->nodes));
+    tree->records = (record_t **)malloc((records + 1) * sizeof(*tree->records));
+    assert(tree->nodes && tree->records);
+    tree->node_count = tree->record_count = 0;
+
+    size_t arena_cap = COMPACT_INLINE_BYTES * 16;
+    tree->prefixes = (char *)malloc(arena_cap);
+    assert(tree->prefixes);
+    tree->prefix_bytes = 0;
+
+    freeze_node(tree, root, &arena_cap);
+    return tree;
+}
+
+
+/* Does exact match search on the compact tree with the same comparison
+ * counting as recursive_exact_search, and records the mismatch node index.
+ */
+uint32_t compact_exact_search(compact_tree_t *tree, char *key, result_t *result,
+        uint32_t *mismatch_node) {
+
+    *mismatch_node = COMPACT_NONE;
+    if (!tree || !tree->node_count) return COMPACT_NONE;
+
+    int total_bits = get_total_bits(key);
+    int curr_bit = START_BIT;
+    uint32_t idx = 0;
+
+    while (idx != COMPACT_NONE) {
+        compact_node_t *node = &tree->nodes[idx];
+
+        result->node_cmps++;
+        int match_count = compare_prefix_bits(key, curr_bit, total_bits,
+            node_prefix(tree, node), node->prefix_bits);
+        result->bit_cmps += match_count;
+
+        // mismatch inside this node's prefix
+        *mismatch_node = idx;
+        if (match_count < (int)node->prefix_bits) {
+            result->bit_cmps++;
+            return COMPACT_NONE;
+        }
+
+        // reached key's end bit, records are one contiguous range
+        curr_bit += node->prefix_bits;
+        if (curr_bit >= total_bits) {
+            result->str_cmps++;
+            for (uint32_t i = node->rec_first; i < node->rec_end; i++) {
+                result->matches[result->match_count++] = tree->records[i];
+            }
+            return idx;
+        }
+
+        idx = getBit(key, curr_bit) == 0 ? node->left : node->right;
+    }
+    return COMPACT_NONE;
+}
+
+
+/* Does closest-match search from the mismatch node's record range. */
+void compact_search_closest(compact_tree_t *tree, uint32_t last_match,
+        char *key, result_t *result) {
+    if (last_match == COMPACT_NONE) return;
+
+    // the whole subtree is one preorder range, copy it in one go
+    compact_node_t *node = &tree->nodes[last_match];
+    int init_count = result->match_count;
+    uint32_t count = node->subtree_end - node->rec_first;
+    memcpy(result->matches + init_count, tree->records + node->rec_first,
+        count * sizeof(record_t *));
+    result->match_count += count;
+
+    select_closest(result, key, init_count);
+}
+
+
+/* Collects records of every key starting with prefix as one range copy. */
+void compact_prefix_search(compact_tree_t *tree, char *prefix, result_t *result) {
+    if (!tree || !tree->node_count) return;
+
+    int total_bits = strlen(prefix) * BITS_PER_BYTE;
+    int curr_bit = START_BIT;
+    uint32_t idx = 0;
+
+    while (idx != COMPACT_NONE) {
+        compact_node_t *node = &tree->nodes[idx];
+        result->node_cmps++;
+        int match_count = compare_prefix_bits(prefix, curr_bit, total_bits,
+            node_prefix(tree, node), node->prefix_bits);
+        result->bit_cmps += match_count;
+
+        if (match_count == total_bits - curr_bit) {
+            uint32_t count = node->subtree_end - node->rec_first;
+            memcpy(result->matches + result->match_count,
+                tree->records + node->rec_first, count * sizeof(record_t *));
+            result->match_count += count;
+            return;
+        }
+        if (match_count < (int)node->prefix_bits) {
+            result->bit_cmps++;
+            return;
+        }
+
+        curr_bit += node->prefix_bits;
+        idx = getBit(prefix, curr_bit) == 0 ? node->left : node->right;
+    }
+}
+
+
+/* Adds the compact tree's memory use to stats. */
+void compact_memory_stats(compact_tree_t *tree, tree_mem_stats_t *stats) {
+    if (!tree) return;
+    stats->node_count += tree->node_count;
+    stats->node_bytes += sizeof(*tree) + tree->node_count * sizeof(compact_node_t);
+    stats->prefix_bytes += tree->prefix_bytes;
+    stats->link_bytes += tree->record_count * sizeof(record_t *);
+    for (uint32_t i = 0; i < tree->record_count; i++) {
+        stats->record_count++;
+        stats->field_bytes += record_memory_bytes(tree->records[i]);
+    }
+}
+
+
+/* Frees the compact tree and all stored records. */
+void free_compact_tree(compact_tree_t *tree) {
+    if (!tree) return;
+    for (uint32_t i = 0; i < tree->record_count; i++) {
+        free_record(tree->records[i]);
+    }
+    free(tree->records);
+    free(tree->nodes);
+    free(tree->prefixes);
+    free(tree);
+}
@@ -0,0 +1,62 @@
+#ifndef _COMPACT_H_
+#define _COMPACT_H_
+#include <stdint.h>
+#include "tree.h"
+#include "record.h"
+#include "result.h"
+
+
+#define COMPACT_NONE UINT32_MAX  // index value for a missing child
+#define COMPACT_INLINE_BYTES 8   // prefixes up to this many bytes stay in the node
+
+
+// Patricia node frozen into a flat array, children and records by index.
+typedef struct {
+    uint32_t left;
+    uint32_t right;
+    uint32_t prefix_bits;
+    uint32_t rec_first;   // first record of this node in the record array
+    uint32_t rec_end;     // one past this node's own records
+    uint32_t subtree_end; // one past the last record below this node
+    union {
+        char bytes[COMPACT_INLINE_BYTES];
+        uint32_t offset;  // into the prefix arena for longer prefixes
+    } prefix;
+} compact_node_t;
+
+typedef struct compact_tree {
+    compact_node_t *nodes; // preorder, node 0 is the root
+    uint32_t node_count;
+    char *prefixes;        // arena holding prefixes too long to inline
+    size_t prefix_bytes;
+    record_t **records;    // preorder, so every subtree is one range
+    uint32_t record_count;
+} compact_tree_t;
+
+
+/* Freezes a Patricia tree into the compact layout. Node memory of the
+ * pointer tree is released, its records move into the compact tree.
+ */
+compact_tree_t *compact_tree_build(tree_node_t *root);
+
+/* Does exact match search on the compact tree with the same comparison
+ * counting as recursive_exact_search, and records the mismatch node index.
+ */
+uint32_t compact_exact_search(compact_tree_t *tree, char *key, result_t *result,
+    uint32_t *mismatch_node);
+
+/* Does closest-match search from the mismatch node's record range. */
+void compact_search_closest(compact_tree_t *tree, uint32_t last_match,
+    char *key, result_t *result);
+
+/* Collects records of every key starting with prefix as one range copy. */
+void compact_prefix_search(compact_tree_t *tree, char *prefix, result_t *result);
+
+/* Adds the compact tree's memory use to stats. */
+void compact_memory_stats(compact_tree_t *tree, tree_mem_stats_t *stats);
+
+/* Frees the compact tree and all stored records. */
+void free_compact_tree(compact_tree_t *tree);
+
+
+#endif
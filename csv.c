@@ -22,6 +22,52 @@ int csv_read_header(FILE *f, char *headers[NUM_FIELDS]) {
 }
 
 
+/* Helper to copy one field starting at *pp into out, unquoting it, and
+ * leave *pp at the start of the next field. Returns the field length.
+ */
+static int scan_field(char **pp, char *out) {
+    char *p = *pp;
+    int field_len = 0;
+
+    // quoted field
+    if (*p == '"') {
+        p++;
+
+        while (*p != '\0') {
+            if (*p == '"') {
+                // meets a double quote, skips
+                if (*(p + 1) == '"') {
+                    out[field_len++] = '"';
+                    p += 2;
+                } else {
+                    // quoted field is ended
+                    p++;
+                    break;
+                }
+            } else {
+                // skip characters inside quoted field
+                out[field_len++] = *p;
+                p++;
+            }
+        }
+    } else {
+        // when unquoted, read until reaches comma
+        while (*p != '\0' && *p != ',') {
+            out[field_len++] = *p;
+            p++;
+        }
+    }
+    out[field_len] = '\0';
+
+    // when read a comma, skip and proceed to the next field
+    if (*p == ',') {
+        p++;
+    }
+    *pp = p;
+    return field_len;
+}
+
+
 /* Parse one CSV address data line into separate strings to store in cols[]. */
 int csv_parse_line(char *line, char *cols[], int expected_fields) {
     int col = 0;
@@ -32,52 +78,52 @@ int csv_parse_line(char *line, char *cols[], int expected_fields) {
     // continue until the end and reached expected number of fields
     while (*p != '\0' && col < expected_fields) {
         char field[MAX_FIELD_LEN];
-        int field_len = 0;
-
-        // quoted field
-        if (*p == '"') {
-            p++;
-
-            while (*p != '\0') {
-                if (*p == '"') {
-                    // meets a double quote, skips
-                    if (*(p + 1) == '"') {
-                        field[field_len++] = '"';
-                        p += 2;
-                    } else {
-                        // quoted field is ended
-                        p++;
-                        break;
-                    }
-                } else {
-                    // skip characters inside quoted field
-                    field[field_len++] = *p;
-                    p++;
-                }
-            }
-        } else {
-            // when unquoted, read until reaches comma
-            while (*p != '\0' && *p != ',') {
-                field[field_len++] = *p;
-                p++;
-            }
-        }
+        scan_field(&p, field);
 
         // end of field and copy to array
-        field[field_len] = '\0';
         cols[col] = strdup(field);
         assert(cols[col] != NULL);
         col++;
-
-        // when read a comma, skip and proceed to the next field
-        if (*p == ',') {
-            p++;
-        }
     }
     return 1;
 }
 
 
+/* Split one CSV line into cols[] pointing into buf, without allocating.
+ * buf needs strlen(line) + expected_fields + 1 bytes. Missing trailing
+ * fields are set to empty strings. Returns the number of fields read.
+ */
+int csv_split_line(char *line, char *buf, char *cols[], int expected_fields) {
+    int col = 0;
+    char *p = line;
+    char *q = buf;
+
+    while (*p != '\0' && col < expected_fields) {
+        cols[col++] = q;
+        q += scan_field(&p, q) + 1;
+    }
+    int read = col;
+    *q = '\0';
+    while (col < expected_fields) {
+        cols[col++] = q;
+    }
+    return read;
+}
+
+
+/* Copy only field number index of a CSV line into out, which needs
+ * strlen(line) + 1 bytes. Returns 1 if the line has that field.
+ */
+int csv_extract_field(char *line, int index, char *out) {
+    char *p = line;
+    for (int col = 0; *p != '\0'; col++) {
+        scan_field(&p, out);
+        if (col == index) return 1;
+    }
+    return 0;
+}
+
+
 /* Helper to remove any trailing '\n' characters after read. */
 void remove_newline(char *s) {
     size_t len = strlen(s);
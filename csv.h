@@ -14,6 +14,17 @@ int csv_read_header(FILE *f, char *headers[NUM_FIELDS]);
 /* Parse one CSV address data line into separate strings to store in cols[]. */
 int csv_parse_line(char *line, char *cols[], int expected_fields);
 
+/* Split one CSV line into cols[] pointing into buf, without allocating.
+ * buf needs strlen(line) + expected_fields + 1 bytes. Missing trailing
+ * fields are set to empty strings. Returns the number of fields read.
+ */
+int csv_split_line(char *line, char *buf, char *cols[], int expected_fields);
+
+/* Copy only field number index of a CSV line into out, which needs
+ * strlen(line) + 1 bytes. Returns 1 if the line has that field.
+ */
+int csv_extract_field(char *line, int index, char *out);
+
 /* Remove any trailing '\n' characters after read. */
 void remove_newline(char *s);
 
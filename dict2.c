@@ -6,67 +6,100 @@
 #include "record.h"
 #include "result.h"
 #include "csv.h"
+#include "options.h"
+#include "loader.h"
+#include "server.h"
+#include "batch.h"
+#include "stats.h"
+#include "output.h"
+#include "pipeline.h"
 
 
-tree_dict_t *build_tree_dict(FILE *in_fp);
-void process_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict);
-void print_result_outfile(FILE *out_fp, tree_dict_t *tree_dict, result_t *res);
-void print_result_stdout(char *input_EZI_ADD, result_t *result);
+void process_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict,
+    output_spec_t *output, search_budget_t *budget, tree_stats_t *stats);
+void process_batch_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict,
+    int batch_size, output_spec_t *output, search_budget_t *budget,
+    tree_stats_t *stats);
 
 
 int main(int argc, char *argv[]) {
     // check if valid arguments
-    if (argc != 4) {
+    if (argc < OPTIONS_START) {
         return 1;
     }
     if (strcmp(argv[1], "2") != 0) {
         return 1;
     }
+    options_t opts;
+    default_options(&opts);
+    if (!parse_options(argc, argv, OPTIONS_START, &opts)) {
+        return 1;
+    }
 
     FILE *in_fp = fopen(argv[2], "r");
     if (!in_fp) { return 1; }
     FILE *out_fp = fopen(argv[3], "w");
     if (!out_fp) { fclose(in_fp); return 1; }
 
-    tree_dict_t *tree_dict = build_tree_dict(in_fp);
+    tree_dict_t *tree_dict = build_tree_dict(in_fp, &opts);
     fclose(in_fp);
 
-    process_search(stdin, out_fp, tree_dict);
-
-    fclose(out_fp);
-    free_tree(tree_dict);
-    return 0;
-}
+    if (opts.mem_stats && tree_dict) {
+        tree_mem_stats_t stats;
+        tree_memory_stats(tree_dict, &stats);
+        print_memory_stats(stderr, &stats);
+    }
 
+    // tree shape is taken once loaded, query costs as they run
+    tree_stats_t stats;
+    tree_stats_t *stats_ptr = NULL;
+    if (opts.tree_stats && tree_dict) {
+        stats_collect_tree(&stats, tree_dict);
+        stats_ptr = &stats;
+    }
 
-/* Reads CSV headers and records, inserts them into a Patricia tree.
- * Returns pointer to the tree dictionary.
- */
-tree_dict_t *build_tree_dict(FILE *in_fp) {
-    char *headers[NUM_FIELDS];
-    tree_dict_t *tree_dict = NULL;
-    if (csv_read_header(in_fp, headers)) {
-        // create dictionary and store header if read successful
-        tree_dict = create_tree_dict(headers);
+    search_budget_t budget = { opts.max_candidates, opts.max_usec };
+
+    // column names are only known once the header is read
+    output_spec_t output;
+    int status = 0;
+    if (tree_dict && !output_spec_init(&output, opts.output, opts.fields,
+            tree_dict->headers)) {
+        status = 1;
+    } else if (opts.serve_path && tree_dict) {
+        // long-running mode, output file receives the server log
+        status = run_server(opts.serve_path, argv[2], &opts, &tree_dict, out_fp);
+    } else if (opts.pipeline && tree_dict) {
+        output_begin(out_fp, &output, tree_dict->headers);
+        pipeline_search(stdin, out_fp, tree_dict, opts.pipeline, &output,
+            &budget, stats_ptr);
+    } else if (opts.batch && tree_dict) {
+        output_begin(out_fp, &output, tree_dict->headers);
+        process_batch_search(stdin, out_fp, tree_dict, opts.batch, &output,
+            &budget, stats_ptr);
+    } else if (tree_dict) {
+        output_begin(out_fp, &output, tree_dict->headers);
+        process_search(stdin, out_fp, tree_dict, &output, &budget, stats_ptr);
     }
 
-    char line[MAX_LINE_LEN];
-    while (fgets(line, sizeof(line), in_fp)) {
-        char *fields[NUM_FIELDS];
-        if (csv_parse_line(line, fields, NUM_FIELDS)) {
-            // create and store successfully read and parsed address record
-            record_t *rec = create_record(fields);
-            insert_tree(tree_dict, rec->fields[EZI_ADD_INDEX], rec);
-        }
+    if (stats_ptr) {
+        print_tree_stats(stderr, stats_ptr);
+        free_tree_stats(stats_ptr);
     }
-    return tree_dict;
+
+    fclose(out_fp);
+    free_tree(tree_dict);
+    return status;
 }
 
 
 /* Implements key search from stdin and searches the tree
- * write results to output file and stdout. 
+ * write results to output file in the output format and to stdout.
+ * Closest matches are bounded by budget, and each query's cost is
+ * added to stats unless it is NULL.
  */
-void process_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict) {
+void process_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict,
+        output_spec_t *output, search_budget_t *budget, tree_stats_t *stats) {
     char input_EZI_ADD[MAX_LINE_LEN];
 
     // while still reading in search key
@@ -74,24 +107,21 @@ void process_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict) {
         remove_newline(input_EZI_ADD);
         if (input_EZI_ADD[0] == '\0') continue;
 
-        fprintf(out_fp, "%s\n", input_EZI_ADD);
-
         result_t *result = (result_t *)malloc(sizeof(*result));
         assert(result);
         initialise_result(result, tree_dict->size);
+        result_set_budget(result, budget);
         
-        // search the tree and try to find exact match
-        tree_node_t *mismatch_node = NULL;
-        tree_node_t *found_node = recursive_exact_search(tree_dict->root, input_EZI_ADD,
-            get_total_bits(input_EZI_ADD), START_BIT, result, &mismatch_node);
-        
-        // if not exact match, find closest match
-        if (!found_node && mismatch_node) {
-            search_closest(mismatch_node, input_EZI_ADD, result);
+        // search the selected index for exact match, else closest match
+        long start = stats ? now_usec() : 0;
+        dict_search(tree_dict, input_EZI_ADD, result);
+        if (stats) {
+            stats_record_query(stats, tree_dict, input_EZI_ADD, result,
+                now_usec() - start);
         }
 
         // Write to output file and stdout
-        print_result_outfile(out_fp, tree_dict, result);
+        output_query(out_fp, output, tree_dict->headers, input_EZI_ADD, result);
         print_result_stdout(input_EZI_ADD, result);
 
         free_result(result);
@@ -100,21 +130,54 @@ void process_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict) {
 }
 
 
-/* Helper to print NOTFOUND or matching records to output file. */
-void print_result_outfile(FILE *out_fp, tree_dict_t *tree_dict, result_t *result) {
-    if (result->match_count == 0) {
-        fputs("NOTFOUND\n", out_fp);
-    } else {
-        for (int i = 0; i < result->match_count; i ++) {
-            print_record(out_fp, result->matches[i], tree_dict->headers);
+/* Reads up to batch_size queries at a time and searches each block together
+ * in sorted order, then writes results in input order exactly as
+ * process_search does. Query costs added to stats cover only the
+ * per-query part after the shared descent.
+ */
+void process_batch_search(FILE *input_in, FILE *out_fp, tree_dict_t *tree_dict,
+        int batch_size, output_spec_t *output, search_budget_t *budget,
+        tree_stats_t *stats) {
+    batch_query_t *queries = (batch_query_t *)malloc(batch_size * sizeof(*queries));
+    assert(queries);
+    char input_EZI_ADD[MAX_LINE_LEN];
+    int more = 1;
+
+    while (more) {
+        // read a block of queries
+        int count = 0;
+        while (count < batch_size) {
+            if (!fgets(input_EZI_ADD, sizeof(input_EZI_ADD), input_in)) {
+                more = 0;
+                break;
+            }
+            remove_newline(input_EZI_ADD);
+            if (input_EZI_ADD[0] == '\0') continue;
+            queries[count++].key = strdup(input_EZI_ADD);
+        }
+
+        batch_search(tree_dict, queries, count);
+
+        for (int i = 0; i < count; i++) {
+            result_t *result = (result_t *)malloc(sizeof(*result));
+            assert(result);
+            initialise_result(result, tree_dict->size);
+            result_set_budget(result, budget);
+            long start = stats ? now_usec() : 0;
+            batch_result(tree_dict, &queries[i], result);
+            if (stats) {
+                stats_record_query(stats, tree_dict, queries[i].key, result,
+                    now_usec() - start);
+            }
+
+            output_query(out_fp, output, tree_dict->headers, queries[i].key, result);
+            print_result_stdout(queries[i].key, result);
+
+            free_result(result);
+            free(result);
+            free(queries[i].key);
         }
     }
+    free(queries);
 }
 
-
-/* Helper to format and print matching records and comparison results to stdout. */
-void print_result_stdout(char *input_EZI_ADD, result_t *result) {
-    printf("%s --> %d records found - comparisons: b%d n%d s%d\n", 
-            input_EZI_ADD, result->match_count, result->bit_cmps, 
-            result->node_cmps, result->str_cmps);
-}
@@ -1,6 +1,11 @@
 #include "edit_dist.h"
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 /* Returns min of 3 integers 
     reference: https://www.geeksforgeeks.org/edit-distance-in-c/ */
@@ -24,41 +29,231 @@ int min(int a, int b, int c) {
     reference: https://www.geeksforgeeks.org/edit-distance-in-c/ */
 int editDistance(char *str1, char *str2, int n, int m){
     assert(m >= 0 && n >= 0 && (str1 || m == 0) && (str2 || n == 0));
-    // Declare a 2D array to store the dynamic programming
-    // table
-    int dp[n + 1][m + 1];
-
-    // Initialize the dp table
-    for (int i = 0; i <= n; i++) {
-        for (int j = 0; j <= m; j++) {
-            // If the first string is empty, the only option
-            // is to insert all characters of the second
-            // string
-            if (i == 0) {
-                dp[i][j] = j;
-            }
-            // If the second string is empty, the only
-            // option is to remove all characters of the
-            // first string
-            else if (j == 0) {
-                dp[i][j] = i;
-            }
-            // If the last characters are the same, no
-            // modification is necessary to the string.
-            else if (str1[i - 1] == str2[j - 1]) {
-                dp[i][j] = min(1 + dp[i - 1][j], 1 + dp[i][j - 1],
-                    dp[i - 1][j - 1]);
+    // Only the previous and current rows of the dynamic programming
+    // table are kept, on the heap so long strings cannot overflow the
+    // stack
+    int *prev = (int *)malloc((m + 1) * sizeof(int));
+    int *curr = (int *)malloc((m + 1) * sizeof(int));
+    assert(prev && curr);
+
+    // If the first string is empty, the only option is to insert all
+    // characters of the second string
+    for (int j = 0; j <= m; j++) {
+        prev[j] = j;
+    }
+
+    for (int i = 1; i <= n; i++) {
+        // If the second string is empty, the only option is to remove
+        // all characters of the first string
+        curr[0] = i;
+        for (int j = 1; j <= m; j++) {
+            // If the last characters are the same, no modification is
+            // necessary to the string.
+            if (str1[i - 1] == str2[j - 1]) {
+                curr[j] = min(1 + prev[j], 1 + curr[j - 1], prev[j - 1]);
             }
-            // If the last characters are different,
-            // consider all three operations and find the
-            // minimum
+            // If the last characters are different, consider all three
+            // operations and find the minimum
             else {
-                dp[i][j] = 1 + min(dp[i - 1][j], dp[i][j - 1],
-                    dp[i - 1][j - 1]);
+                curr[j] = 1 + min(prev[j], curr[j - 1], prev[j - 1]);
+            }
+        }
+        int *tmp = prev;
+        prev = curr;
+        curr = tmp;
+    }
+
+    // Return the result from the last row
+    int dist = prev[m];
+    free(prev);
+    free(curr);
+    return dist;
+}
+
+
+/* Scores up to lanes candidates at once, one candidate per 16-bit lane,
+    walking the query rows and candidate columns in lockstep. Candidates
+    are padded to the longest one; a lane's result is read from its own
+    column, which never depends on the padding. cand and row are scratch
+    arrays of max_m * lanes and (max_m + 1) * lanes int16 values. */
+#define EDIT_ROW(j) (row + (j) * lanes)
+
+static void batchScalar(char *query, int n, char **cands, int *lens, int count,
+        int *out) {
+    for (int k = 0; k < count; k++) {
+        out[k] = editDistance(query, cands[k], n, lens[k]);
+    }
+}
+
+/* Transposes a chunk of candidates so column j of every lane is adjacent. */
+static int loadLanes(char **cands, int *lens, int count, int lanes,
+        short *cand) {
+    int max_m = 0;
+    for (int k = 0; k < count; k++) {
+        if (lens[k] > max_m) max_m = lens[k];
+    }
+    for (int j = 0; j < max_m; j++) {
+        for (int k = 0; k < lanes; k++) {
+            cand[j * lanes + k] = (k < count && j < lens[k])
+                ? (unsigned char)cands[k][j] : -1;
+        }
+    }
+    return max_m;
+}
+
+#ifdef __SSE2__
+#define SSE_LANES 8
+#define AVX_LANES EDIT_BATCH_LANES
+
+static void batchSse2(char *query, int n, char **cands, int *lens, int count,
+        int *out, short *cand, short *row) {
+    const int lanes = SSE_LANES;
+    int max_m = loadLanes(cands, lens, count, lanes, cand);
+    __m128i ones = _mm_set1_epi16(1);
+
+    for (int j = 0; j <= max_m; j++) {
+        _mm_storeu_si128((__m128i *)EDIT_ROW(j), _mm_set1_epi16(j));
+    }
+    for (int i = 1; i <= n; i++) {
+        __m128i qc = _mm_set1_epi16((unsigned char)query[i - 1]);
+        __m128i diag = _mm_loadu_si128((__m128i *)EDIT_ROW(0));
+        __m128i left = _mm_set1_epi16(i);
+        _mm_storeu_si128((__m128i *)EDIT_ROW(0), left);
+        for (int j = 1; j <= max_m; j++) {
+            __m128i up = _mm_loadu_si128((__m128i *)EDIT_ROW(j));
+            __m128i eq = _mm_cmpeq_epi16(qc,
+                _mm_loadu_si128((__m128i *)(cand + (j - 1) * lanes)));
+            // substitution is free on a match, insert/delete always cost 1
+            __m128i sub = _mm_add_epi16(diag, _mm_andnot_si128(eq, ones));
+            __m128i val = _mm_min_epi16(sub,
+                _mm_add_epi16(_mm_min_epi16(up, left), ones));
+            _mm_storeu_si128((__m128i *)EDIT_ROW(j), val);
+            diag = up;
+            left = val;
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        out[k] = EDIT_ROW(lens[k])[k];
+    }
+}
+
+__attribute__((target("avx2")))
+static void batchAvx2(char *query, int n, char **cands, int *lens, int count,
+        int *out, short *cand, short *row) {
+    const int lanes = AVX_LANES;
+    int max_m = loadLanes(cands, lens, count, lanes, cand);
+    __m256i ones = _mm256_set1_epi16(1);
+
+    for (int j = 0; j <= max_m; j++) {
+        _mm256_storeu_si256((__m256i *)EDIT_ROW(j), _mm256_set1_epi16(j));
+    }
+    for (int i = 1; i <= n; i++) {
+        __m256i qc = _mm256_set1_epi16((unsigned char)query[i - 1]);
+        __m256i diag = _mm256_loadu_si256((__m256i *)EDIT_ROW(0));
+        __m256i left = _mm256_set1_epi16(i);
+        _mm256_storeu_si256((__m256i *)EDIT_ROW(0), left);
+        for (int j = 1; j <= max_m; j++) {
+            __m256i up = _mm256_loadu_si256((__m256i *)EDIT_ROW(j));
+            __m256i eq = _mm256_cmpeq_epi16(qc,
+                _mm256_loadu_si256((__m256i *)(cand + (j - 1) * lanes)));
+            __m256i sub = _mm256_add_epi16(diag, _mm256_andnot_si256(eq, ones));
+            __m256i val = _mm256_min_epi16(sub,
+                _mm256_add_epi16(_mm256_min_epi16(up, left), ones));
+            _mm256_storeu_si256((__m256i *)EDIT_ROW(j), val);
+            diag = up;
+            left = val;
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        out[k] = EDIT_ROW(lens[k])[k];
+    }
+}
+#endif
+
+
+/* Returns the edit distance of query against each of count candidates,
+    identical to calling editDistance on each. Candidates are scored
+    EDIT_BATCH_LANES at a time in AVX2 lanes, 8 at a time with SSE2,
+    or one by one where neither is available. */
+void editDistanceBatch(char *query, int n, char **cands, int *lens, int count,
+        int *out) {
+    assert(n >= 0 && count >= 0);
+#ifdef __SSE2__
+    int max_m = 0;
+    for (int k = 0; k < count; k++) {
+        if (lens[k] > max_m) max_m = lens[k];
+    }
+    // 16-bit lanes hold any distance below EDIT_BATCH_MAX_LEN
+    if (n < EDIT_BATCH_MAX_LEN && max_m < EDIT_BATCH_MAX_LEN && count > 1) {
+        int avx = __builtin_cpu_supports("avx2");
+        int lanes = avx ? AVX_LANES : SSE_LANES;
+        short *cand = (short *)malloc((max_m + 1) * lanes * sizeof(short));
+        short *row = (short *)malloc((max_m + 1) * lanes * sizeof(short));
+        assert(cand && row);
+
+        for (int start = 0; start < count; start += lanes) {
+            int chunk = count - start < lanes ? count - start : lanes;
+            if (avx) {
+                batchAvx2(query, n, cands + start, lens + start, chunk,
+                    out + start, cand, row);
+            } else {
+                batchSse2(query, n, cands + start, lens + start, chunk,
+                    out + start, cand, row);
             }
         }
+        free(cand);
+        free(row);
+        return;
+    }
+#endif
+    batchScalar(query, n, cands, lens, count, out);
+}
+
+
+/* Returns the histogram bucket of a character: case-folded letters,
+    pairs of digits, then one bucket for every other byte. */
+static int histBucket(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return c - 'a';
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= '0' && c <= '9') return 26 + (c - '0') / 2;
+    return HIST_BUCKETS - 1;
+}
+
+
+/* Counts the characters of str into hist. */
+void charHistogram(char *str, char_hist_t *hist) {
+    memset(hist, 0, sizeof(*hist));
+    for (unsigned char *p = (unsigned char *)str; *p; p++) {
+        int b = histBucket(*p);
+        if (hist->count[b] < UCHAR_MAX) hist->count[b]++;
     }
+}
 
-    // Return the result from the dynamic programming table
-    return dp[n][m];
+
+/* Returns a lower bound on the edit distance of the strings behind two
+    histograms. Each edit removes at most one character and adds at most
+    one, so the distance is at least the larger of the characters only a
+    has and the characters only b has. This also covers the length
+    difference. Merged buckets and saturated counts only lower it. */
+int histogramBound(char_hist_t *a, char_hist_t *b) {
+    int extra_a = 0, extra_b = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < HIST_BUCKETS; i += 16) {
+        __m128i va = _mm_loadu_si128((__m128i *)(a->count + i));
+        __m128i vb = _mm_loadu_si128((__m128i *)(b->count + i));
+        // saturating subtract keeps only the positive differences
+        __m128i sa = _mm_sad_epu8(_mm_subs_epu8(va, vb), zero);
+        __m128i sb = _mm_sad_epu8(_mm_subs_epu8(vb, va), zero);
+        extra_a += _mm_cvtsi128_si32(sa) + _mm_extract_epi16(sa, 4);
+        extra_b += _mm_cvtsi128_si32(sb) + _mm_extract_epi16(sb, 4);
+    }
+#else
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        int diff = a->count[i] - b->count[i];
+        if (diff > 0) extra_a += diff;
+        else extra_b -= diff;
+    }
+#endif
+    return extra_a > extra_b ? extra_a : extra_b;
 }
@@ -1,7 +1,22 @@
 #ifndef _EDIT_DISTANCE_H_
 #define _EDIT_DISTANCE_H_
 
+/* Longest strings the batch scorer handles in 16-bit lanes. */
+#define EDIT_BATCH_MAX_LEN 32000
+#define EDIT_BATCH_LANES 16 // candidates per AVX2 batch
+
+#define HIST_BUCKETS 32 // letters, digit pairs and everything else
+
+/* Character counts of a string, saturating at 255 per bucket. */
+typedef struct {
+    unsigned char count[HIST_BUCKETS];
+} char_hist_t;
+
 int editDistance(char *str1, char *str2, int n, int m);
 int min(int a, int b, int c);
+void editDistanceBatch(char *query, int n, char **cands, int *lens, int count,
+    int *out);
+void charHistogram(char *str, char_hist_t *hist);
+int histogramBound(char_hist_t *a, char_hist_t *b);
 
 #endif
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "exact_hash.h"
+#include "hash.h"
+
+
+/* Returns key's slot: its entry if present, else the empty slot ending
+ * its probe sequence.
+ */
+static exact_entry_t *probe(exact_hash_t *hash, char *key, uint32_t h) {
+    size_t mask = hash->cap - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        exact_entry_t *entry = &hash->entries[i];
+        if (!entry->key) return entry;
+        if (entry->hash == h && strcmp(entry->key, key) == 0) return entry;
+    }
+}
+
+
+/* Builds the table from a finished dictionary of any index type, running
+ * its exact search once per distinct key. With tree_counters set, hits
+ * report the counters that search produced; otherwise a hit counts one
+ * string comparison and its bits, and no nodes.
+ */
+exact_hash_t *exact_hash_build(tree_dict_t *dict, int tree_counters) {
+    exact_hash_t *hash = (exact_hash_t *)malloc(sizeof(*hash));
+    assert(hash);
+    hash->cap = 16;
+    while (hash->cap < 2 * dict->size) hash->cap *= 2;
+    hash->entries = (exact_entry_t *)calloc(hash->cap, sizeof(exact_entry_t));
+    hash->records = (record_t **)malloc((dict->size + 1) * sizeof(record_t *));
+    assert(hash->entries && hash->records);
+    hash->keys = 0;
+    hash->record_count = 0;
+    hash->tree_counters = tree_counters;
+
+    // every record, from the empty prefix
+    result_t all, found;
+    initialise_result(&all, dict->size);
+    initialise_result(&found, dict->size);
+    dict_prefix_search(dict, "", &all);
+
+    for (int i = 0; i < all.match_count; i++) {
+        char *key = get_record_key(all.matches[i]);
+        uint32_t h = hash_string(key);
+        exact_entry_t *entry = probe(hash, key, h);
+        if (entry->key) continue;
+
+        // the tree's own answer fixes record order and counters
+        found.match_count = 0;
+        found.bit_cmps = found.node_cmps = found.str_cmps = 0;
+        dict_exact_search(dict, key, &found);
+        assert(found.match_count > 0);
+
+        entry->key = get_record_key(found.matches[0]);
+        entry->hash = h;
+        entry->first = hash->record_count;
+        entry->count = found.match_count;
+        entry->bit_cmps = found.bit_cmps;
+        entry->node_cmps = found.node_cmps;
+        entry->str_cmps = found.str_cmps;
+        memcpy(hash->records + hash->record_count, found.matches,
+            found.match_count * sizeof(record_t *));
+        hash->record_count += found.match_count;
+        hash->keys++;
+    }
+
+    free_result(&all);
+    free_result(&found);
+    return hash;
+}
+
+
+/* Returns the entry for key, or NULL if the key is not in the dictionary. */
+exact_entry_t *exact_hash_find(exact_hash_t *hash, char *key) {
+    exact_entry_t *entry = probe(hash, key, hash_string(key));
+    return entry->key ? entry : NULL;
+}
+
+
+/* Appends key's records to result on a hit and returns 1. On a miss
+ * returns 0 and leaves result untouched, so the tree can be searched.
+ */
+int exact_hash_search(exact_hash_t *hash, char *key, result_t *result) {
+    exact_entry_t *entry = exact_hash_find(hash, key);
+    if (!entry) return 0;
+    exact_hash_append(hash, entry, key, result);
+    return 1;
+}
+
+
+/* Appends the records of entry, found by exact_hash_find for key, to
+ * result with the counters of a hit.
+ */
+void exact_hash_append(exact_hash_t *hash, exact_entry_t *entry, char *key,
+        result_t *result) {
+    if (hash->tree_counters) {
+        result->bit_cmps += entry->bit_cmps;
+        result->node_cmps += entry->node_cmps;
+        result->str_cmps += entry->str_cmps;
+    } else {
+        // the confirming comparison of the probe
+        compare_strings_bits(key, entry->key, &result->bit_cmps);
+        result->str_cmps++;
+    }
+    memcpy(result->matches + result->match_count, hash->records + entry->first,
+        entry->count * sizeof(record_t *));
+    result->match_count += entry->count;
+}
+
+
+/* Adds the table's memory use to stats. */
+void exact_hash_memory_stats(exact_hash_t *hash, tree_mem_stats_t *stats) {
+    if (!hash) return;
+    stats->node_bytes += sizeof(*hash) + hash->cap * sizeof(exact_entry_t);
+    stats->link_bytes += hash->record_count * sizeof(record_t *);
+}
+
+
+/* Frees the table, not the records. */
+void free_exact_hash(exact_hash_t *hash) {
+    if (!hash) return;
+    free(hash->entries);
+    free(hash->records);
+    free(hash);
+}
@@ -0,0 +1,60 @@
+#ifndef _EXACT_HASH_H_
+#define _EXACT_HASH_H_
+#include <stdint.h>
+#include <stddef.h>
+#include "tree.h"
+#include "record.h"
+#include "result.h"
+
+
+// one distinct key, its records and the tree's exact search counters for it
+typedef struct {
+    char *key;        // the records' own key string, NULL when empty
+    uint32_t hash;
+    uint32_t first;   // first record in the table's record array
+    uint32_t count;
+    int bit_cmps;
+    int node_cmps;
+    int str_cmps;
+} exact_entry_t;
+
+// open addressing table over every key of a dictionary
+typedef struct exact_hash {
+    exact_entry_t *entries;
+    size_t cap;       // power of two, at least twice the key count
+    size_t keys;
+    record_t **records; // grouped by key, in the tree's exact match order
+    size_t record_count;
+    int tree_counters;  // report the tree's counters on a hit
+} exact_hash_t;
+
+
+/* Builds the table from a finished dictionary of any index type, running
+ * its exact search once per distinct key. With tree_counters set, hits
+ * report the counters that search produced; otherwise a hit counts one
+ * string comparison and its bits, and no nodes.
+ */
+exact_hash_t *exact_hash_build(tree_dict_t *dict, int tree_counters);
+
+/* Returns the entry for key, or NULL if the key is not in the dictionary. */
+exact_entry_t *exact_hash_find(exact_hash_t *hash, char *key);
+
+/* Appends the records of entry, found by exact_hash_find for key, to
+ * result with the counters of a hit.
+ */
+void exact_hash_append(exact_hash_t *hash, exact_entry_t *entry, char *key,
+    result_t *result);
+
+/* Appends key's records to result on a hit and returns 1. On a miss
+ * returns 0 and leaves result untouched, so the tree can be searched.
+ */
+int exact_hash_search(exact_hash_t *hash, char *key, result_t *result);
+
+/* Adds the table's memory use to stats. */
+void exact_hash_memory_stats(exact_hash_t *hash, tree_mem_stats_t *stats);
+
+/* Frees the table, not the records. */
+void free_exact_hash(exact_hash_t *hash);
+
+
+#endif
@@ -0,0 +1,18 @@
+#include <string.h>
+#include "hash.h"
+
+
+/* Returns the FNV-1a hash of len bytes of s. */
+uint32_t hash_bytes(char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+/* Returns the FNV-1a hash of a string. */
+uint32_t hash_string(char *s) {
+    return hash_bytes(s, strlen(s));
+}
@@ -0,0 +1,14 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+#include <stdint.h>
+#include <stddef.h>
+
+
+/* Returns the FNV-1a hash of len bytes of s. */
+uint32_t hash_bytes(char *s, size_t len);
+
+/* Returns the FNV-1a hash of a string. */
+uint32_t hash_string(char *s);
+
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "loader.h"
+#include "csv.h"
+#include "shard.h"
+#include "exact_hash.h"
+#include "token_index.h"
+
+
+// records created but not yet inserted, for parallel sharded builds
+typedef struct {
+    record_t **records;
+    size_t count;
+    size_t cap;
+} pending_t;
+
+
+/* Helper to insert a record, or queue it when the dictionary is built
+ * in shards.
+ */
+static void add_record_to_dict(tree_dict_t *tree_dict, options_t *opts,
+        record_t *rec, pending_t *pending) {
+    if (!opts->shards) {
+        insert_tree(tree_dict, get_record_key(rec), rec);
+        return;
+    }
+    if (pending->count == pending->cap) {
+        pending->cap = pending->cap ? pending->cap * 2 : MAX_LINE_LEN;
+        pending->records = (record_t **)realloc(pending->records,
+            pending->cap * sizeof(record_t *));
+        assert(pending->records);
+    }
+    pending->records[pending->count++] = rec;
+}
+
+
+/* Helper to create a record from parsed fields and add it. */
+static void add_row(tree_dict_t *tree_dict, options_t *opts, char *fields[NUM_FIELDS],
+        pending_t *pending) {
+    add_record_to_dict(tree_dict, opts, create_record(tree_dict->store, fields), pending);
+}
+
+
+/* Helper to choose the encoded columns from the sampled rows, then add
+ * the held rows in file order and free the sample.
+ */
+static void release_sample(tree_dict_t *tree_dict, options_t *opts, char **sample,
+        int sampled, pending_t *pending) {
+    store_choose_columns(tree_dict->store, sample, sampled);
+    for (int r = 0; r < sampled; r++) {
+        add_row(tree_dict, opts, sample + r * NUM_FIELDS, pending);
+    }
+    free(sample);
+}
+
+
+/* Reads CSV headers and records, inserts them into a Patricia tree.
+ * Lazy loads parse only the key column and keep each raw row, or with
+ * LAZY_DISK only where the row lies in the file. Otherwise the first
+ * STORE_SAMPLE_ROWS rows are held back to choose which columns
+ * the record store dictionary-encodes.
+ * Returns pointer to the tree dictionary.
+ */
+tree_dict_t *build_tree_dict(FILE *in_fp, options_t *opts) {
+    char *headers[NUM_FIELDS];
+    tree_dict_t *tree_dict = NULL;
+    if (csv_read_header(in_fp, headers)) {
+        // create dictionary and store header if read successful
+        tree_dict = create_tree_dict(headers, opts->index_type);
+    }
+    if (!tree_dict) return NULL;
+
+    pending_t pending = { NULL, 0, 0 };
+    char **sample = NULL;
+    int sampled = 0;
+    // rows can only be read back from a seekable file
+    int disk = opts->lazy == LAZY_DISK && ftello(in_fp) >= 0;
+    if (disk) {
+        store_set_disk(tree_dict->store, dup(fileno(in_fp)), opts->row_cache);
+    } else if (opts->lazy) {
+        store_set_lazy(tree_dict->store, opts->lazy == LAZY_MEMO);
+    } else if (opts->encode) {
+        sample = (char **)malloc(STORE_SAMPLE_ROWS * NUM_FIELDS * sizeof(char *));
+        assert(sample);
+    }
+
+    char line[MAX_LINE_LEN];
+    while (fgets(line, sizeof(line), in_fp)) {
+        if (opts->lazy) {
+            // parse only the key, keep the raw row or its position for later
+            off_t offset = disk ? ftello(in_fp) - (off_t)strlen(line) : 0;
+            char key[MAX_LINE_LEN];
+            remove_newline(line);
+            if (!csv_extract_field(line, EZI_ADD_INDEX, key)) continue;
+            record_t *rec = disk
+                ? create_disk_record(tree_dict->store, strdup(key), offset, strlen(line))
+                : create_lazy_record(tree_dict->store, strdup(key), strdup(line));
+            add_record_to_dict(tree_dict, opts, rec, &pending);
+            continue;
+        }
+
+        char *fields[NUM_FIELDS];
+        if (!csv_parse_line(line, fields, NUM_FIELDS)) continue;
+
+        if (sample) {
+            // hold the row back until the sample is complete
+            memcpy(sample + sampled * NUM_FIELDS, fields, sizeof(fields));
+            if (++sampled == STORE_SAMPLE_ROWS) {
+                release_sample(tree_dict, opts, sample, sampled, &pending);
+                sample = NULL;
+            }
+            continue;
+        }
+        // create and store successfully read and parsed address record
+        add_row(tree_dict, opts, fields, &pending);
+    }
+    if (sample) {
+        // fewer rows than the sample size
+        release_sample(tree_dict, opts, sample, sampled, &pending);
+    }
+
+    if (opts->shards) {
+        shard_dict_build(tree_dict, pending.records, pending.count, opts->shards,
+            opts->shard_by, opts->shard_pin);
+    }
+    free(pending.records);
+    tree_finalise(tree_dict);
+    if (opts->exact_hash) {
+        tree_dict->exact = exact_hash_build(tree_dict,
+            opts->exact_hash == EXACT_HASH_TREE_COUNTERS);
+    }
+    if (opts->token_index) {
+        tree_dict->tokens = token_index_build(tree_dict);
+    }
+    return tree_dict;
+}
+
+
+/* Opens the CSV at path and builds a dictionary from it.
+ * Returns NULL if the file cannot be opened or has no header.
+ */
+tree_dict_t *load_tree_dict(char *path, options_t *opts) {
+    FILE *in_fp = fopen(path, "r");
+    if (!in_fp) return NULL;
+    tree_dict_t *tree_dict = build_tree_dict(in_fp, opts);
+    fclose(in_fp);
+    return tree_dict;
+}
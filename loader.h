@@ -0,0 +1,19 @@
+#ifndef _LOADER_H_
+#define _LOADER_H_
+#include <stdio.h>
+#include "tree.h"
+#include "options.h"
+
+
+/* Reads CSV headers and records, inserts them into a Patricia tree.
+ * Returns pointer to the tree dictionary.
+ */
+tree_dict_t *build_tree_dict(FILE *in_fp, options_t *opts);
+
+/* Opens the CSV at path and builds a dictionary from it.
+ * Returns NULL if the file cannot be opened or has no header.
+ */
+tree_dict_t *load_tree_dict(char *path, options_t *opts);
+
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "protocol.h"
+#include "csv.h"
+#include "result.h"
+
+
+#define LOADGEN_DEFAULT_CONNS 4
+#define LOADGEN_DEFAULT_DEPTH 16
+#define LOADGEN_DEFAULT_REQUESTS 100000
+#define LOADGEN_READ_CHUNK 65536
+
+
+// state of one load generating connection
+typedef struct {
+    int fd;
+    buffer_t in;
+    buffer_t out;
+    long *sent_at;   // send time per in-flight request, FIFO ring
+    int first;
+    int in_flight;
+} load_conn_t;
+
+
+char **read_queries(char *path, int *count);
+int compare_long(const void *a, const void *b);
+
+
+/* Load generator for the lookup server. Replays queries from query_file
+ * round robin over several pipelined connections and reports throughput
+ * and latency percentiles.
+ * Usage: dict2_loadgen <socket> <query_file> [--conns=N] [--depth=N]
+ *        [--requests=N] [--op=exact|closest|prefix]
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        return 1;
+    }
+    int conns = LOADGEN_DEFAULT_CONNS;
+    int depth = LOADGEN_DEFAULT_DEPTH;
+    long total = LOADGEN_DEFAULT_REQUESTS;
+    uint8_t op = OP_CLOSEST;
+    for (int i = 3; i < argc; i++) {
+        if (strncmp(argv[i], "--conns=", 8) == 0) {
+            conns = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+            depth = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--requests=", 11) == 0) {
+            total = atol(argv[i] + 11);
+        } else if (strcmp(argv[i], "--op=exact") == 0) {
+            op = OP_EXACT;
+        } else if (strcmp(argv[i], "--op=closest") == 0) {
+            op = OP_CLOSEST;
+        } else if (strcmp(argv[i], "--op=prefix") == 0) {
+            op = OP_PREFIX;
+        } else {
+            return 1;
+        }
+    }
+    if (conns < 1 || depth < 1 || total < 1) return 1;
+
+    int query_count = 0;
+    char **queries = read_queries(argv[2], &query_count);
+    if (!queries || query_count == 0) return 1;
+
+    load_conn_t *lc = (load_conn_t *)calloc(conns, sizeof(*lc));
+    struct pollfd *pfds = (struct pollfd *)calloc(conns, sizeof(*pfds));
+    long *latency = (long *)malloc(total * sizeof(*latency));
+    assert(lc && pfds && latency);
+    for (int c = 0; c < conns; c++) {
+        lc[c].fd = proto_connect(argv[1]);
+        if (lc[c].fd < 0) return 1;
+        fcntl(lc[c].fd, F_SETFL, fcntl(lc[c].fd, F_GETFL, 0) | O_NONBLOCK);
+        buffer_init(&lc[c].in);
+        buffer_init(&lc[c].out);
+        lc[c].sent_at = (long *)malloc(depth * sizeof(long));
+        assert(lc[c].sent_at);
+    }
+
+    long issued = 0, done = 0, errors = 0;
+    long start = now_usec();
+    while (done < total) {
+        for (int c = 0; c < conns; c++) {
+            load_conn_t *conn = &lc[c];
+            // keep the pipeline full
+            while (conn->in_flight < depth && issued < total) {
+                proto_put_request(&conn->out, op, issued,
+                    queries[issued % query_count]);
+                conn->sent_at[(conn->first + conn->in_flight++) % depth] = now_usec();
+                issued++;
+            }
+            pfds[c].fd = conn->fd;
+            pfds[c].events = POLLIN | (conn->out.len ? POLLOUT : 0);
+        }
+        if (poll(pfds, conns, -1) < 0 && errno != EINTR) break;
+
+        for (int c = 0; c < conns; c++) {
+            load_conn_t *conn = &lc[c];
+            if (pfds[c].revents & POLLOUT) {
+                ssize_t n = write(conn->fd, conn->out.data, conn->out.len);
+                if (n > 0) buffer_consume(&conn->out, n);
+            }
+            if (pfds[c].revents & (POLLERR | POLLHUP) && !(pfds[c].revents & POLLIN)) {
+                fprintf(stderr, "connection %d closed by server\n", c);
+                return 1;
+            }
+            if (!(pfds[c].revents & POLLIN)) continue;
+
+            buffer_reserve(&conn->in, LOADGEN_READ_CHUNK);
+            ssize_t n = read(conn->fd, conn->in.data + conn->in.len, LOADGEN_READ_CHUNK);
+            if (n <= 0) {
+                fprintf(stderr, "connection %d closed by server\n", c);
+                return 1;
+            }
+            conn->in.len += n;
+
+            // complete responses finish the oldest in-flight request
+            long body_len;
+            while ((body_len = proto_frame_ready(&conn->in, PROTO_MAX_RESPONSE)) > 0) {
+                response_head_t head;
+                proto_get_response_head(conn->in.data + PROTO_LEN_BYTES, &head);
+                if (head.status == STATUS_BAD_REQUEST) errors++;
+                latency[done++] = now_usec() - conn->sent_at[conn->first];
+                conn->first = (conn->first + 1) % depth;
+                conn->in_flight--;
+                buffer_consume(&conn->in, PROTO_LEN_BYTES + body_len);
+            }
+        }
+    }
+    long elapsed = now_usec() - start;
+
+    qsort(latency, done, sizeof(*latency), compare_long);
+    printf("requests %ld errors %ld conns %d depth %d\n", done, errors, conns, depth);
+    printf("elapsed %.3f s throughput %.0f req/s\n", elapsed / 1e6,
+        elapsed ? done * 1e6 / elapsed : 0.0);
+    printf("latency us: p50 %ld p90 %ld p99 %ld max %ld\n",
+        latency[done / 2], latency[done * 9 / 10], latency[done * 99 / 100],
+        latency[done - 1]);
+
+    for (int c = 0; c < conns; c++) {
+        close(lc[c].fd);
+        buffer_free(&lc[c].in);
+        buffer_free(&lc[c].out);
+        free(lc[c].sent_at);
+    }
+    for (int i = 0; i < query_count; i++) free(queries[i]);
+    free(queries);
+    free(lc);
+    free(pfds);
+    free(latency);
+    return 0;
+}
+
+
+/* Reads non-empty lines of path into an array. */
+char **read_queries(char *path, int *count) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+    int cap = 64;
+    char **queries = (char **)malloc(cap * sizeof(*queries));
+    assert(queries);
+    char line[MAX_LINE_LEN];
+    while (fgets(line, sizeof(line), fp)) {
+        remove_newline(line);
+        if (line[0] == '\0') continue;
+        if (*count == cap) {
+            cap *= 2;
+            queries = (char **)realloc(queries, cap * sizeof(*queries));
+            assert(queries);
+        }
+        queries[(*count)++] = strdup(line);
+    }
+    fclose(fp);
+    return queries;
+}
+
+
+/* qsort comparator for longs. */
+int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "tree.h"
+#include "shard.h"
+#include "batch.h"
+#include "record.h"
+#include "output.h"
+#include "pipeline.h"
+
+
+/* Sets every option to its default value. */
+void default_options(options_t *opts) {
+    opts->index_type = INDEX_PATRICIA;
+    opts->lazy = LAZY_OFF;
+    opts->row_cache = 0;
+    opts->encode = 1;
+    opts->mem_stats = 0;
+    opts->shards = 0;
+    opts->shard_by = SHARD_BY_PREFIX;
+    opts->shard_pin = 0;
+    opts->serve_path = NULL;
+    opts->batch = 0;
+    opts->tree_stats = 0;
+    opts->exact_hash = EXACT_HASH_OFF;
+    opts->max_candidates = 0;
+    opts->max_usec = 0;
+    opts->output = OUTPUT_TEXT;
+    opts->fields = NULL;
+    opts->pipeline = 0;
+    opts->token_index = 0;
+    opts->reload_path = NULL;
+}
+
+
+/* Helper to match "--name=" and return the value after it, or NULL. */
+static char *option_value(char *arg, char *name) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+        return arg + len + 1;
+    }
+    return NULL;
+}
+
+
+/* Parses optional "--name=value" flags from argv[start] onwards.
+ * Returns 1 on success, 0 on an unknown flag or bad value, or on --batch
+ * with an index other than patricia or with --shards.
+ */
+int parse_options(int argc, char *argv[], int start, options_t *opts) {
+    for (int i = start; i < argc; i++) {
+        char *value = NULL;
+
+        if ((value = option_value(argv[i], "--index"))) {
+            if (strcmp(value, "patricia") == 0) {
+                opts->index_type = INDEX_PATRICIA;
+            } else if (strcmp(value, "art") == 0) {
+                opts->index_type = INDEX_ART;
+            } else if (strcmp(value, "compact") == 0) {
+                opts->index_type = INDEX_COMPACT;
+            } else {
+                return 0;
+            }
+        } else if ((value = option_value(argv[i], "--shards"))) {
+            opts->shards = atoi(value);
+            if (opts->shards < 1 || opts->shards > MAX_SHARDS) return 0;
+        } else if ((value = option_value(argv[i], "--shard-by"))) {
+            if (strcmp(value, "prefix") == 0) {
+                opts->shard_by = SHARD_BY_PREFIX;
+            } else if (strcmp(value, "postcode") == 0) {
+                opts->shard_by = SHARD_BY_POSTCODE;
+            } else {
+                return 0;
+            }
+        } else if ((value = option_value(argv[i], "--serve"))) {
+            if (value[0] == '\0') return 0;
+            opts->serve_path = value;
+        } else if ((value = option_value(argv[i], "--batch"))) {
+            opts->batch = atoi(value);
+            if (opts->batch < 1 || opts->batch > MAX_BATCH) return 0;
+        } else if ((value = option_value(argv[i], "--max-candidates"))) {
+            opts->max_candidates = atoi(value);
+            if (opts->max_candidates < 1) return 0;
+        } else if ((value = option_value(argv[i], "--max-usec"))) {
+            opts->max_usec = atol(value);
+            if (opts->max_usec < 1) return 0;
+        } else if (strcmp(argv[i], "--shard-pin") == 0) {
+            opts->shard_pin = 1;
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            opts->lazy = LAZY_SPLIT;
+        } else if ((value = option_value(argv[i], "--lazy"))) {
+            if (strcmp(value, "split") == 0) {
+                opts->lazy = LAZY_SPLIT;
+            } else if (strcmp(value, "memo") == 0) {
+                opts->lazy = LAZY_MEMO;
+            } else if (strcmp(value, "disk") == 0) {
+                opts->lazy = LAZY_DISK;
+            } else {
+                return 0;
+            }
+        } else if ((value = option_value(argv[i], "--output"))) {
+            if (strcmp(value, "text") == 0) {
+                opts->output = OUTPUT_TEXT;
+            } else if (strcmp(value, "ndjson") == 0) {
+                opts->output = OUTPUT_NDJSON;
+            } else if (strcmp(value, "tsv") == 0) {
+                opts->output = OUTPUT_TSV;
+            } else if (strcmp(value, "binary") == 0) {
+                opts->output = OUTPUT_BINARY;
+            } else {
+                return 0;
+            }
+        } else if ((value = option_value(argv[i], "--fields"))) {
+            if (value[0] == '\0') return 0;
+            opts->fields = value;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            opts->pipeline = PIPELINE_DEFAULT_DEPTH;
+        } else if ((value = option_value(argv[i], "--pipeline"))) {
+            opts->pipeline = atoi(value);
+            if (opts->pipeline < 1 || opts->pipeline > MAX_PIPELINE_DEPTH) return 0;
+        } else if ((value = option_value(argv[i], "--reload-from"))) {
+            if (value[0] == '\0') return 0;
+            opts->reload_path = value;
+        } else if ((value = option_value(argv[i], "--row-cache"))) {
+            opts->row_cache = atoi(value);
+            if (opts->row_cache < 0 || opts->row_cache > MAX_ROW_CACHE) return 0;
+        } else if (strcmp(argv[i], "--no-encode") == 0) {
+            opts->encode = 0;
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            opts->mem_stats = 1;
+        } else if (strcmp(argv[i], "--tree-stats") == 0) {
+            opts->tree_stats = 1;
+        } else if (strcmp(argv[i], "--token-index") == 0) {
+            opts->token_index = 1;
+        } else if (strcmp(argv[i], "--exact-hash") == 0) {
+            opts->exact_hash = EXACT_HASH_ON;
+        } else if ((value = option_value(argv[i], "--exact-hash"))) {
+            if (strcmp(value, "tree-counters") == 0) {
+                opts->exact_hash = EXACT_HASH_TREE_COUNTERS;
+            } else {
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+    }
+
+    // the batched descent only exists for the unsharded Patricia tree
+    if (opts->batch && (opts->index_type != INDEX_PATRICIA || opts->shards)) {
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+
+#define OPTIONS_START 4 // argv position of the first optional flag
+
+// load modes for --lazy
+#define LAZY_OFF 0
+#define LAZY_SPLIT 1 // split the raw row on every access
+#define LAZY_MEMO 2  // split once and keep the fields
+#define LAZY_DISK 3  // keep only the key and read the row from the file
+
+// modes for --exact-hash
+#define EXACT_HASH_OFF 0
+#define EXACT_HASH_ON 1            // hits count one string comparison
+#define EXACT_HASH_TREE_COUNTERS 2 // hits report the tree search's counters
+
+
+// type definition for optional command-line settings after <stage> <in> <out>
+typedef struct {
+    int index_type; // INDEX_PATRICIA, INDEX_ART or INDEX_COMPACT
+    int lazy;       // LAZY_OFF, LAZY_SPLIT, LAZY_MEMO or LAZY_DISK
+    int row_cache;  // disk rows kept in memory for --lazy=disk, 0 for none
+    int encode;     // dictionary-encode low-cardinality columns
+    int mem_stats;  // print memory accounting to stderr after build
+    int shards;     // number of shard trees, 0 for a single tree
+    int shard_by;   // SHARD_BY_PREFIX or SHARD_BY_POSTCODE
+    int shard_pin;  // pin shard build threads to CPUs
+    char *serve_path; // Unix socket to serve lookups on instead of stdin
+    int batch;      // queries searched together in sorted order, 0 for one by one
+    int tree_stats; // print tree shape and query cost report to stderr
+    int exact_hash; // EXACT_HASH_OFF, EXACT_HASH_ON or EXACT_HASH_TREE_COUNTERS
+    int max_candidates; // closest-match keys scored per query, 0 for no limit
+    long max_usec;      // closest-match time per query, 0 for no limit
+    int output;     // OUTPUT_TEXT, OUTPUT_NDJSON, OUTPUT_TSV or OUTPUT_BINARY
+    char *fields;   // comma separated header names to output, NULL for all
+    int pipeline;   // queries in flight between pipelined stages, 0 for none
+    int token_index; // try token postings before the index's closest match
+    char *reload_path; // CSV the server rebuilds from on SIGHUP, NULL for the input
+} options_t;
+
+
+/* Sets every option to its default value. */
+void default_options(options_t *opts);
+
+/* Parses optional "--name=value" flags from argv[start] onwards.
+ * Returns 1 on success, 0 on an unknown flag or bad value, or on --batch
+ * with an index other than patricia or with --shards.
+ */
+int parse_options(int argc, char *argv[], int start, options_t *opts);
+
+
+#endif
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "output.h"
+#include "tree.h"
+
+
+/* Sets up spec for format with the columns named in the comma separated
+ * list fields (all columns in file order if NULL).
+ * Returns 1 on success, 0 if a name is not one of headers.
+ */
+int output_spec_init(output_spec_t *spec, int format, char *fields,
+        char *headers[NUM_FIELDS]) {
+    spec->format = format;
+    spec->field_count = 0;
+    if (!fields) {
+        for (int i = 0; i < NUM_FIELDS; i++) spec->fields[spec->field_count++] = i;
+        return 1;
+    }
+
+    for (char *name = fields; ; ) {
+        char *end = strchr(name, ',');
+        size_t len = end ? (size_t)(end - name) : strlen(name);
+        int found = -1;
+        for (int i = 0; i < NUM_FIELDS; i++) {
+            if (strlen(headers[i]) == len && strncmp(headers[i], name, len) == 0) {
+                found = i;
+                break;
+            }
+        }
+        if (found < 0 || spec->field_count == NUM_FIELDS) return 0;
+        spec->fields[spec->field_count++] = found;
+        if (!end) break;
+        name = end + 1;
+    }
+    return 1;
+}
+
+
+/* Helper to write a big-endian integer of bytes bytes. */
+static void put_be(FILE *f, uint32_t v, int bytes) {
+    while (bytes--) fputc((v >> (8 * bytes)) & 0xff, f);
+}
+
+
+/* Helper to write a string as u16 length and bytes, cut at 65535 bytes. */
+static void put_binary_string(FILE *f, char *s) {
+    size_t len = strlen(s);
+    if (len > UINT16_MAX) len = UINT16_MAX;
+    put_be(f, len, 2);
+    fwrite(s, 1, len, f);
+}
+
+
+/* Helper to write a JSON string literal. */
+static void put_json_string(FILE *f, char *s) {
+    fputc('"', f);
+    for (unsigned char *p = (unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', f);
+            fputc(*p, f);
+        } else if (*p < 0x20) {
+            fprintf(f, "\\u%04x", *p);
+        } else {
+            fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
+
+/* Helper to write a TSV cell, escaping the characters that split rows. */
+static void put_tsv_cell(FILE *f, char *s) {
+    for (; *s; s++) {
+        switch (*s) {
+        case '\t': fputs("\\t", f); break;
+        case '\n': fputs("\\n", f); break;
+        case '\r': fputs("\\r", f); break;
+        case '\\': fputs("\\\\", f); break;
+        default: fputc(*s, f);
+        }
+    }
+}
+
+
+/* Writes what the format puts before the first query: the TSV header row
+ * (query, status, then the projected columns), or for binary output a
+ * big-endian u32 column count followed by each projected header as u16
+ * length and bytes. Text and NDJSON write nothing.
+ */
+void output_begin(FILE *f, output_spec_t *spec, char *headers[NUM_FIELDS]) {
+    if (spec->format == OUTPUT_TSV) {
+        fputs("query\tstatus", f);
+        for (int j = 0; j < spec->field_count; j++) {
+            fputc('\t', f);
+            put_tsv_cell(f, headers[spec->fields[j]]);
+        }
+        fputc('\n', f);
+    } else if (spec->format == OUTPUT_BINARY) {
+        put_be(f, spec->field_count, 4);
+        for (int j = 0; j < spec->field_count; j++) {
+            put_binary_string(f, headers[spec->fields[j]]);
+        }
+    }
+}
+
+
+/* Helper to name how a query was answered: exact, closest, approximate
+ * (closest match cut short by the budget) or notfound.
+ */
+static char *match_status(char *key, result_t *result) {
+    if (result->match_count == 0) return "notfound";
+    if (result->approximate) return "approximate";
+    if (strcmp(get_record_key(result->matches[0]), key) == 0) return "exact";
+    return "closest";
+}
+
+
+/* Helper to write one TSV row: the query, its status, then the projected
+ * columns of fields, or empty cells if fields is NULL.
+ */
+static void put_tsv_row(FILE *f, output_spec_t *spec, char *key, char *status,
+        char *fields[NUM_FIELDS]) {
+    put_tsv_cell(f, key);
+    fputc('\t', f);
+    fputs(status, f);
+    for (int j = 0; j < spec->field_count; j++) {
+        fputc('\t', f);
+        if (fields) put_tsv_cell(f, fields[spec->fields[j]]);
+    }
+    fputc('\n', f);
+}
+
+
+/* Helper to write one record as a JSON object. */
+static void put_json_record(FILE *f, output_spec_t *spec, char *headers[NUM_FIELDS],
+        char *fields[NUM_FIELDS]) {
+    fputc('{', f);
+    for (int j = 0; j < spec->field_count; j++) {
+        int i = spec->fields[j];
+        if (j) fputc(',', f);
+        put_json_string(f, headers[i]);
+        fputc(':', f);
+        put_json_string(f, fields[i]);
+    }
+    fputc('}', f);
+}
+
+
+/* Writes one query and its matching records. Text keeps the stage 2
+ * format with rounded coordinates; the other formats copy field values
+ * as stored. TSV writes a row per record, or one row with empty columns
+ * for a query with no match, each led by the query and its status
+ * (exact, closest, approximate or notfound). A binary query is u32 key
+ * length, key bytes, u8 approximate flag and u32 record count, then per
+ * record each projected field as u16 length and bytes.
+ */
+void output_query(FILE *f, output_spec_t *spec, char *headers[NUM_FIELDS],
+        char *key, result_t *result) {
+    switch (spec->format) {
+    case OUTPUT_TEXT:
+        fputs(key, f);
+        fputc('\n', f);
+        if (result->match_count == 0) fputs("NOTFOUND\n", f);
+        break;
+    case OUTPUT_NDJSON:
+        fputs("{\"query\":", f);
+        put_json_string(f, key);
+        if (result->approximate) fputs(",\"approximate\":true", f);
+        fputs(",\"records\":[", f);
+        break;
+    case OUTPUT_TSV:
+        // a no-match query still gets its row
+        if (result->match_count == 0) put_tsv_row(f, spec, key, "notfound", NULL);
+        break;
+    case OUTPUT_BINARY:
+        put_be(f, strlen(key), 4);
+        fputs(key, f);
+        put_be(f, result->approximate ? 1 : 0, 1);
+        put_be(f, result->match_count, 4);
+        break;
+    }
+
+    for (int r = 0; r < result->match_count; r++) {
+        // one decode per record, then only the projected columns are written
+        char *fields[NUM_FIELDS];
+        record_fields(result->matches[r], fields);
+
+        switch (spec->format) {
+        case OUTPUT_TEXT:
+            print_projected_fields(f, fields, headers, spec->fields,
+                spec->field_count);
+            break;
+        case OUTPUT_NDJSON:
+            if (r) fputc(',', f);
+            put_json_record(f, spec, headers, fields);
+            break;
+        case OUTPUT_TSV:
+            put_tsv_row(f, spec, key, match_status(key, result), fields);
+            break;
+        case OUTPUT_BINARY:
+            for (int j = 0; j < spec->field_count; j++) {
+                put_binary_string(f, fields[spec->fields[j]]);
+            }
+            break;
+        }
+    }
+
+    if (spec->format == OUTPUT_NDJSON) fputs("]}\n", f);
+}
+
+
+/* Helper to format and print matching records and comparison results to stdout. */
+void print_result_stdout(char *input_EZI_ADD, result_t *result) {
+    printf("%s --> %d records found - comparisons: b%d n%d s%d%s\n", 
+            input_EZI_ADD, result->match_count, result->bit_cmps, 
+            result->node_cmps, result->str_cmps,
+            result->approximate ? " - approximate" : "");
+}
@@ -0,0 +1,52 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+#include <stdio.h>
+#include "record.h"
+#include "result.h"
+
+
+// output file formats for --output
+#define OUTPUT_TEXT 0   // query line, then "header: value || " records or NOTFOUND
+#define OUTPUT_NDJSON 1 // one {"query": ..., "records": [...]} object per line
+#define OUTPUT_TSV 2    // header row, then query and status prefixed rows
+#define OUTPUT_BINARY 3 // length-prefixed fields, see output_begin
+
+
+// type definition for the output format and the projected columns
+typedef struct {
+    int format;
+    int fields[NUM_FIELDS]; // column indices to write, in order
+    int field_count;
+} output_spec_t;
+
+
+/* Sets up spec for format with the columns named in the comma separated
+ * list fields (all columns in file order if NULL).
+ * Returns 1 on success, 0 if a name is not one of headers.
+ */
+int output_spec_init(output_spec_t *spec, int format, char *fields,
+    char *headers[NUM_FIELDS]);
+
+/* Writes what the format puts before the first query: the TSV header row
+ * (query, status, then the projected columns), or for binary output a
+ * big-endian u32 column count followed by each projected header as u16
+ * length and bytes. Text and NDJSON write nothing.
+ */
+void output_begin(FILE *f, output_spec_t *spec, char *headers[NUM_FIELDS]);
+
+/* Writes one query and its matching records. Text keeps the stage 2
+ * format with rounded coordinates; the other formats copy field values
+ * as stored. TSV writes a row per record, or one row with empty columns
+ * for a query with no match, each led by the query and its status
+ * (exact, closest, approximate or notfound). A binary query is u32 key
+ * length, key bytes, u8 approximate flag and u32 record count, then per
+ * record each projected field as u16 length and bytes.
+ */
+void output_query(FILE *f, output_spec_t *spec, char *headers[NUM_FIELDS],
+    char *key, result_t *result);
+
+/* Helper to format and print matching records and comparison results to stdout. */
+void print_result_stdout(char *input_EZI_ADD, result_t *result);
+
+
+#endif
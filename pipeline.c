@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "pipeline.h"
+
+
+#define RING_SPINS 64 // empty or full checks before yielding the CPU
+
+
+// bounded ring with one producer and one consumer, NULL marks the end
+typedef struct {
+    void **slots;
+    size_t mask;              // capacity - 1, capacity is a power of two
+    _Atomic size_t head;      // next slot to pop, advanced by the consumer
+    _Atomic size_t tail;      // next slot to push, advanced by the producer
+} ring_t;
+
+// one query on its way through the stages
+typedef struct {
+    char *key;
+    result_t result;
+    long usec;
+} pipe_query_t;
+
+// shared state of the search and writer stages
+typedef struct {
+    ring_t to_search;
+    ring_t to_write;
+    FILE *out_fp;
+    tree_dict_t *dict;
+    output_spec_t *output;
+    search_budget_t *budget;
+    tree_stats_t *stats;
+} pipeline_t;
+
+
+/* Helper to set up an empty ring of at least depth slots. */
+static void ring_init(ring_t *ring, int depth) {
+    size_t cap = 2;
+    while (cap < (size_t)depth) cap *= 2;
+    ring->slots = (void **)malloc(cap * sizeof(void *));
+    assert(ring->slots);
+    ring->mask = cap - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+
+/* Adds item, waiting while the ring is full. */
+static void ring_push(ring_t *ring, void *item) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (int spins = 0;
+            tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask;
+            spins++) {
+        if (spins >= RING_SPINS) sched_yield();
+    }
+    ring->slots[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+
+/* Removes and returns the oldest item, waiting while the ring is empty. */
+static void *ring_pop(ring_t *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    for (int spins = 0;
+            atomic_load_explicit(&ring->tail, memory_order_acquire) == head;
+            spins++) {
+        if (spins >= RING_SPINS) sched_yield();
+    }
+    void *item = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return item;
+}
+
+
+/* Search stage: looks up every query and passes it on to the writer. */
+static void *search_stage(void *arg) {
+    pipeline_t *pipe = (pipeline_t *)arg;
+    pipe_query_t *query;
+
+    // searches run in one full size result, queries in flight only hold
+    // their own matches
+    result_t scratch;
+    initialise_result(&scratch, pipe->dict->size);
+
+    while ((query = (pipe_query_t *)ring_pop(&pipe->to_search))) {
+        clear_result(&scratch);
+        result_set_budget(&scratch, pipe->budget);
+
+        long start = pipe->stats ? now_usec() : 0;
+        dict_search(pipe->dict, query->key, &scratch);
+        query->usec = pipe->stats ? now_usec() - start : 0;
+
+        query->result = scratch;
+        query->result.matches = (record_t **)malloc(
+            (scratch.match_count + 1) * sizeof(record_t *));
+        assert(query->result.matches);
+        memcpy(query->result.matches, scratch.matches,
+            scratch.match_count * sizeof(record_t *));
+
+        ring_push(&pipe->to_write, query);
+    }
+    ring_push(&pipe->to_write, NULL);
+    free_result(&scratch);
+    return NULL;
+}
+
+
+/* Writer stage: writes each result to the output file and stdout. */
+static void *write_stage(void *arg) {
+    pipeline_t *pipe = (pipeline_t *)arg;
+    pipe_query_t *query;
+
+    while ((query = (pipe_query_t *)ring_pop(&pipe->to_write))) {
+        if (pipe->stats) {
+            stats_record_query(pipe->stats, pipe->dict, query->key,
+                &query->result, query->usec);
+        }
+        output_query(pipe->out_fp, pipe->output, pipe->dict->headers,
+            query->key, &query->result);
+        print_result_stdout(query->key, &query->result);
+
+        free_result(&query->result);
+        free(query->key);
+        free(query);
+    }
+    return NULL;
+}
+
+
+/* Helper to hand one non-empty query line to the search stage. */
+static void push_query(pipeline_t *pipe, char *line, size_t len) {
+    if (len == 0) return;
+    pipe_query_t *query = (pipe_query_t *)malloc(sizeof(*query));
+    assert(query);
+    query->key = (char *)malloc(len + 1);
+    assert(query->key);
+    memcpy(query->key, line, len);
+    query->key[len] = '\0';
+    ring_push(&pipe->to_search, query);
+}
+
+
+/* Helper to append len bytes of a line to the partial line buffer,
+ * doubling its capacity whenever the line outgrows it.
+ */
+static void append_partial(char **partial, size_t *partial_len,
+        size_t *partial_cap, char *p, size_t len) {
+    if (len == 0) return;
+    if (*partial_len + len > *partial_cap) {
+        *partial_cap = 2 * (*partial_len + len);
+        *partial = (char *)realloc(*partial, *partial_cap);
+        assert(*partial);
+    }
+    memcpy(*partial + *partial_len, p, len);
+    *partial_len += len;
+}
+
+
+/* Runs the queries from in through three stages: the calling thread reads
+ * large blocks and splits them into queries of any length, a search thread
+ * looks each one up, and a writer thread writes the results to out_fp and
+ * stdout exactly as process_search does. Stages are joined by bounded
+ * single-producer single-consumer rings of depth queries, so a stage that
+ * falls behind holds back the one feeding it.
+ */
+void pipeline_search(FILE *in, FILE *out_fp, tree_dict_t *tree_dict, int depth,
+        output_spec_t *output, search_budget_t *budget, tree_stats_t *stats) {
+    pipeline_t pipe;
+    pipe.out_fp = out_fp;
+    pipe.dict = tree_dict;
+    pipe.output = output;
+    pipe.budget = budget;
+    pipe.stats = stats;
+    ring_init(&pipe.to_search, depth);
+    ring_init(&pipe.to_write, depth);
+
+    pthread_t searcher, writer;
+    int err = pthread_create(&searcher, NULL, search_stage, &pipe);
+    assert(err == 0);
+    err = pthread_create(&writer, NULL, write_stage, &pipe);
+    assert(err == 0);
+
+    // reader stage: a line may span any number of blocks
+    char *block = (char *)malloc(PIPELINE_READ_BLOCK);
+    char *partial = NULL;
+    size_t partial_len = 0, partial_cap = 0;
+    assert(block);
+
+    size_t got;
+    while ((got = fread(block, 1, PIPELINE_READ_BLOCK, in)) > 0) {
+        char *p = block, *end = block + got;
+        char *newline;
+        while ((newline = (char *)memchr(p, '\n', end - p))) {
+            if (partial_len) {
+                // finish the line carried over from earlier blocks
+                append_partial(&partial, &partial_len, &partial_cap, p,
+                    newline - p);
+                push_query(&pipe, partial, partial_len);
+                partial_len = 0;
+            } else {
+                push_query(&pipe, p, newline - p);
+            }
+            p = newline + 1;
+        }
+
+        // keep the unfinished tail for the next block
+        append_partial(&partial, &partial_len, &partial_cap, p, end - p);
+    }
+    push_query(&pipe, partial, partial_len);
+    ring_push(&pipe.to_search, NULL);
+
+    pthread_join(searcher, NULL);
+    pthread_join(writer, NULL);
+    free(block);
+    free(partial);
+    free(pipe.to_search.slots);
+    free(pipe.to_write.slots);
+}
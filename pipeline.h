@@ -0,0 +1,26 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+#include <stdio.h>
+#include "tree.h"
+#include "result.h"
+#include "output.h"
+#include "stats.h"
+
+
+#define PIPELINE_DEFAULT_DEPTH 1024 // queries in flight between two stages
+#define MAX_PIPELINE_DEPTH 65536
+#define PIPELINE_READ_BLOCK 65536   // bytes the reader pulls per fread
+
+
+/* Runs the queries from in through three stages: the calling thread reads
+ * large blocks and splits them into queries of any length, a search thread
+ * looks each one up, and a writer thread writes the results to out_fp and
+ * stdout exactly as process_search does. Stages are joined by bounded
+ * single-producer single-consumer rings of depth queries, so a stage that
+ * falls behind holds back the one feeding it.
+ */
+void pipeline_search(FILE *in, FILE *out_fp, tree_dict_t *tree_dict, int depth,
+    output_spec_t *output, search_budget_t *budget, tree_stats_t *stats);
+
+
+#endif
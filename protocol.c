@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.h"
+
+
+/* Initialises an empty buffer. */
+void buffer_init(buffer_t *buf) {
+    buf->data = NULL;
+    buf->len = buf->cap = 0;
+}
+
+
+/* Makes room for at least extra more bytes. */
+void buffer_reserve(buffer_t *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) return;
+    size_t cap = buf->cap ? buf->cap : 256;
+    while (cap < buf->len + extra) cap *= 2;
+    buf->data = (char *)realloc(buf->data, cap);
+    assert(buf->data);
+    buf->cap = cap;
+}
+
+
+/* Appends len bytes to the buffer. */
+void buffer_append(buffer_t *buf, const void *bytes, size_t len) {
+    buffer_reserve(buf, len);
+    memcpy(buf->data + buf->len, bytes, len);
+    buf->len += len;
+}
+
+
+/* Appends big-endian integers. */
+void buffer_put_u8(buffer_t *buf, uint8_t v) {
+    buffer_append(buf, &v, 1);
+}
+
+void buffer_put_u16(buffer_t *buf, uint16_t v) {
+    unsigned char b[2] = { v >> 8, v & 0xff };
+    buffer_append(buf, b, sizeof(b));
+}
+
+void buffer_put_u32(buffer_t *buf, uint32_t v) {
+    buffer_reserve(buf, 4);
+    buf->len += 4;
+    buffer_set_u32(buf, buf->len - 4, v);
+}
+
+
+/* Overwrites a big-endian u32 at offset, used to patch frame lengths. */
+void buffer_set_u32(buffer_t *buf, size_t offset, uint32_t v) {
+    unsigned char *p = (unsigned char *)buf->data + offset;
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+
+/* Drops the first n bytes. */
+void buffer_consume(buffer_t *buf, size_t n) {
+    assert(n <= buf->len);
+    if (n == 0) return; // data may still be NULL
+    memmove(buf->data, buf->data + n, buf->len - n);
+    buf->len -= n;
+}
+
+
+/* Frees the buffer memory. */
+void buffer_free(buffer_t *buf) {
+    free(buf->data);
+    buffer_init(buf);
+}
+
+
+/* Reads big-endian integers. */
+uint16_t get_u16(const char *p) {
+    const unsigned char *u = (const unsigned char *)p;
+    return (uint16_t)((u[0] << 8) | u[1]);
+}
+
+uint32_t get_u32(const char *p) {
+    const unsigned char *u = (const unsigned char *)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16)
+        | ((uint32_t)u[2] << 8) | u[3];
+}
+
+
+/* Returns the body length if buf starts with a complete frame, 0 if more
+ * bytes are needed, or -1 if the announced body exceeds max_body.
+ */
+long proto_frame_ready(buffer_t *buf, size_t max_body) {
+    if (buf->len < PROTO_LEN_BYTES) return 0;
+    uint32_t body = get_u32(buf->data);
+    if (body > max_body) return -1;
+    if (buf->len < PROTO_LEN_BYTES + body) return 0;
+    return body;
+}
+
+
+/* Appends a request frame. */
+void proto_put_request(buffer_t *buf, uint8_t op, uint32_t id, const char *key) {
+    size_t key_len = strlen(key);
+    buffer_put_u32(buf, PROTO_REQUEST_FIXED + key_len);
+    buffer_put_u8(buf, op);
+    buffer_put_u32(buf, id);
+    buffer_append(buf, key, key_len);
+}
+
+
+/* Decodes the fixed part of a response body. */
+void proto_get_response_head(const char *body, response_head_t *head) {
+    head->status = (uint8_t)body[0];
+    head->id = get_u32(body + 1);
+    head->count = get_u32(body + 5);
+    head->bit_cmps = get_u32(body + 9);
+    head->node_cmps = get_u32(body + 13);
+    head->str_cmps = get_u32(body + 17);
+}
+
+
+/* Connects to a Unix socket, returns the fd or -1. */
+int proto_connect(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/* Blocking helpers: write all bytes, read exactly len bytes.
+ * Return 1 on success, 0 on error or EOF.
+ */
+int proto_write_all(int fd, const char *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, bytes, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        bytes += n;
+        len -= n;
+    }
+    return 1;
+}
+
+int proto_read_exact(int fd, char *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, bytes, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        bytes += n;
+        len -= n;
+    }
+    return 1;
+}
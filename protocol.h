@@ -0,0 +1,99 @@
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Frame layout shared by the lookup server, client and load generator.
+ * Every frame is a 4 byte big-endian length followed by that many bytes.
+ * Request body:  op (1) | id (4) | key bytes
+ * Response body: status (1) | id (4) | count (4) | b (4) | n (4) | s (4)
+ *                then count records of NUM_FIELDS (len (2) | bytes) fields
+ * Responses on a connection come back in request order.
+ */
+#define PROTO_LEN_BYTES 4
+#define PROTO_REQUEST_FIXED 5    // op + id
+#define PROTO_RESPONSE_FIXED 21  // status + id + count + b + n + s
+#define PROTO_MAX_REQUEST 65536  // largest request body accepted
+#define PROTO_MAX_RESPONSE (1u << 30)
+
+// request operations
+#define OP_EXACT 1   // exact key only
+#define OP_CLOSEST 2 // exact key, else closest key (as dict2 stage 2)
+#define OP_PREFIX 3  // every key starting with the given prefix
+#define OP_HEADERS 4 // column header names, returned as one record
+
+// response status
+#define STATUS_OK 0
+#define STATUS_NOTFOUND 1
+#define STATUS_BAD_REQUEST 2
+#define STATUS_APPROXIMATE 3 // closest match cut short by the server's budget
+
+
+// growable byte buffer for frame assembly and socket I/O
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+// decoded response header
+typedef struct {
+    uint8_t status;
+    uint32_t id;
+    uint32_t count;
+    uint32_t bit_cmps;
+    uint32_t node_cmps;
+    uint32_t str_cmps;
+} response_head_t;
+
+
+/* Initialises an empty buffer. */
+void buffer_init(buffer_t *buf);
+
+/* Makes room for at least extra more bytes. */
+void buffer_reserve(buffer_t *buf, size_t extra);
+
+/* Appends len bytes to the buffer. */
+void buffer_append(buffer_t *buf, const void *bytes, size_t len);
+
+/* Appends big-endian integers. */
+void buffer_put_u8(buffer_t *buf, uint8_t v);
+void buffer_put_u16(buffer_t *buf, uint16_t v);
+void buffer_put_u32(buffer_t *buf, uint32_t v);
+
+/* Overwrites a big-endian u32 at offset, used to patch frame lengths. */
+void buffer_set_u32(buffer_t *buf, size_t offset, uint32_t v);
+
+/* Drops the first n bytes. */
+void buffer_consume(buffer_t *buf, size_t n);
+
+/* Frees the buffer memory. */
+void buffer_free(buffer_t *buf);
+
+/* Reads big-endian integers. */
+uint16_t get_u16(const char *p);
+uint32_t get_u32(const char *p);
+
+/* Returns the body length if buf starts with a complete frame, 0 if more
+ * bytes are needed, or -1 if the announced body exceeds max_body.
+ */
+long proto_frame_ready(buffer_t *buf, size_t max_body);
+
+/* Appends a request frame. */
+void proto_put_request(buffer_t *buf, uint8_t op, uint32_t id, const char *key);
+
+/* Decodes the fixed part of a response body. */
+void proto_get_response_head(const char *body, response_head_t *head);
+
+/* Connects to a Unix socket, returns the fd or -1. */
+int proto_connect(const char *path);
+
+/* Blocking helpers: write all bytes, read exactly len bytes.
+ * Return 1 on success, 0 on error or EOF.
+ */
+int proto_write_all(int fd, const char *bytes, size_t len);
+int proto_read_exact(int fd, char *bytes, size_t len);
+
+
+#endif
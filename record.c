@@ -3,44 +3,455 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include "csv.h"
+#include "hash.h"
 
 
-/* Creates and returns an empty record. */
-record_t *create_record(char *cols[NUM_FIELDS]) {
-    record_t *rec = (record_t *)malloc(sizeof(*rec));
+/* Helper to grow a column dictionary's hash table and rehash. */
+static void column_dict_grow(column_dict_t *dict) {
+    uint32_t cap = dict->table_cap ? dict->table_cap * 2 : 64;
+    uint32_t *table = (uint32_t *)calloc(cap, sizeof(*table));
+    assert(table);
+    for (uint32_t code = 0; code < dict->count; code++) {
+        uint32_t pos = hash_string(dict->values[code]) & (cap - 1);
+        while (table[pos]) pos = (pos + 1) & (cap - 1);
+        table[pos] = code + 1;
+    }
+    free(dict->table);
+    dict->table = table;
+    dict->table_cap = cap;
+}
+
+
+/* Returns the code of value in the column dictionary, adding it if new.
+ * *added tells whether the dictionary now references value itself.
+ */
+static uint32_t column_dict_intern(column_dict_t *dict, char *value, int *added) {
+    // keep the table at most half full
+    if ((dict->count + 1) * 2 > dict->table_cap) {
+        column_dict_grow(dict);
+    }
+
+    uint32_t pos = hash_string(value) & (dict->table_cap - 1);
+    while (dict->table[pos]) {
+        uint32_t code = dict->table[pos] - 1;
+        if (strcmp(dict->values[code], value) == 0) {
+            *added = 0;
+            return code;
+        }
+        pos = (pos + 1) & (dict->table_cap - 1);
+    }
+
+    if (dict->count == dict->cap) {
+        dict->cap = dict->cap ? dict->cap * 2 : 16;
+        dict->values = (char **)realloc(dict->values, dict->cap * sizeof(char *));
+        assert(dict->values);
+    }
+    dict->values[dict->count] = value;
+    dict->table[pos] = dict->count + 1;
+    *added = 1;
+    return dict->count++;
+}
+
+
+/* Helper to free a column dictionary's arrays, and its strings if owned. */
+static void column_dict_free(column_dict_t *dict, int owns_values) {
+    if (owns_values) {
+        for (uint32_t code = 0; code < dict->count; code++) {
+            free(dict->values[code]);
+        }
+    }
+    free(dict->values);
+    free(dict->table);
+    memset(dict, 0, sizeof(*dict));
+}
+
+
+/* Creates a store with every column kept as a plain string. */
+record_store_t *create_record_store(void) {
+    record_store_t *store = (record_store_t *)calloc(1, sizeof(*store));
+    assert(store);
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        store->encoded[i] = 0;
+        store->slot[i] = i;
+    }
+    store->plain_count = NUM_FIELDS;
+    store->coded_count = 0;
+    store->disk_fd = -1;
+    return store;
+}
+
+
+/* Chooses which columns to dictionary-encode from sampled rows
+ * (rows * NUM_FIELDS strings). Must be called before any record is created.
+ */
+void store_choose_columns(record_store_t *store, char **sample, int rows) {
+    store->plain_count = store->coded_count = 0;
+
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        // count distinct sampled values, borrowing the sample strings
+        column_dict_t seen;
+        memset(&seen, 0, sizeof(seen));
+        int added;
+        for (int r = 0; r < rows; r++) {
+            column_dict_intern(&seen, sample[r * NUM_FIELDS + i], &added);
+        }
+        uint32_t distinct = seen.count;
+        column_dict_free(&seen, 0);
+
+        // the key column stays plain so lookups never decode
+        store->encoded[i] = i != EZI_ADD_INDEX && rows > 0
+            && (distinct <= STORE_SMALL_DISTINCT
+                || (uint32_t)rows >= STORE_DISTINCT_RATIO * distinct);
+        if (store->encoded[i]) {
+            store->slot[i] = store->coded_count++;
+        } else {
+            store->slot[i] = store->plain_count++;
+        }
+    }
+}
+
+
+/* Switches an unused store to lazy records, optionally memoizing the
+ * split fields of each record on first access.
+ */
+void store_set_lazy(record_store_t *store, int memoize) {
+    store->lazy = 1;
+    store->memoize = memoize;
+    store->plain_count = LAZY_SLOTS;
+    store->coded_count = 0;
+}
+
+
+/* Switches an unused store to lazy records whose rows stay on disk and
+ * are read from fd when accessed, keeping up to cache_rows of them in a
+ * row cache. The store takes ownership of fd.
+ */
+void store_set_disk(record_store_t *store, int fd, size_t cache_rows) {
+    store_set_lazy(store, 0);
+    store->disk_fd = fd;
+    if (!cache_rows) return;
+
+    row_cache_t *cache = (row_cache_t *)malloc(sizeof(*cache));
+    assert(cache);
+    cache->slots = cache_rows;
+    cache->offsets = (off_t *)malloc(cache_rows * sizeof(off_t));
+    cache->rows = (char **)calloc(cache_rows, sizeof(char *));
+    assert(cache->offsets && cache->rows);
+    for (size_t i = 0; i < cache_rows; i++) cache->offsets[i] = -1;
+    pthread_mutex_init(&cache->lock, NULL);
+    store->cache = cache;
+}
+
+
+/* Helper to free a row cache and its rows. */
+static void row_cache_free(row_cache_t *cache) {
+    if (!cache) return;
+    for (size_t i = 0; i < cache->slots; i++) free(cache->rows[i]);
+    free(cache->rows);
+    free(cache->offsets);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+
+/* Frees the store's column dictionaries and interned strings. */
+void free_record_store(record_store_t *store) {
+    if (!store) return;
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        column_dict_free(&store->dicts[i], 1);
+    }
+    row_cache_free(store->cache);
+    if (store->disk_fd >= 0) close(store->disk_fd);
+    free(store);
+}
+
+
+/* Returns bytes held by the store's column dictionaries. */
+size_t store_memory_bytes(record_store_t *store) {
+    if (!store) return 0;
+    size_t bytes = sizeof(*store);
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        column_dict_t *dict = &store->dicts[i];
+        bytes += dict->cap * sizeof(char *) + dict->table_cap * sizeof(uint32_t);
+        for (uint32_t code = 0; code < dict->count; code++) {
+            bytes += strlen(dict->values[code]) + 1;
+        }
+    }
+    if (store->cache) {
+        row_cache_t *cache = store->cache;
+        bytes += sizeof(*cache) + cache->slots * (sizeof(off_t) + sizeof(char *));
+        for (size_t i = 0; i < cache->slots; i++) {
+            if (cache->rows[i]) bytes += strlen(cache->rows[i]) + 1;
+        }
+    }
+    return bytes;
+}
+
+
+/* Helper returning the codes that follow a record's plain values. */
+static uint32_t *record_codes(record_t *rec) {
+    return (uint32_t *)(rec->values + rec->store->plain_count);
+}
+
+
+/* Creates and returns a record, taking ownership of the column strings. */
+record_t *create_record(record_store_t *store, char *cols[NUM_FIELDS]) {
+    record_t *rec = (record_t *)malloc(sizeof(*rec)
+        + store->plain_count * sizeof(char *)
+        + store->coded_count * sizeof(uint32_t));
+    assert(rec);
+    rec->store = store;
+    charHistogram(cols[EZI_ADD_INDEX], &rec->key_hist);
+
+    uint32_t *codes = record_codes(rec);
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        if (!store->encoded[i]) {
+            rec->values[store->slot[i]] = cols[i];
+            continue;
+        }
+        // repeated values share the dictionary's copy
+        int added;
+        codes[store->slot[i]] = column_dict_intern(&store->dicts[i], cols[i], &added);
+        if (!added) {
+            free(cols[i]);
+        }
+    }
+    return rec;
+}
+
+
+/* Creates a lazy record from its key and raw CSV row, taking ownership
+ * of both strings.
+ */
+record_t *create_lazy_record(record_store_t *store, char *key, char *row) {
+    assert(store->lazy);
+    record_t *rec = (record_t *)malloc(sizeof(*rec) + LAZY_SLOTS * sizeof(char *));
     assert(rec);
+    rec->store = store;
+    charHistogram(key, &rec->key_hist);
+    rec->values[LAZY_KEY_SLOT] = key;
+    rec->values[LAZY_ROW_SLOT] = row;
+    rec->values[LAZY_MEMO_SLOT] = NULL;
+    return rec;
+}
 
-    for (int i = 0; i < NUM_FIELDS; i ++) {
-        rec->fields[i] = cols[i];
-    } 
+
+/* Creates a disk record from its key and its row's position in the
+ * store's file, taking ownership of the key.
+ */
+record_t *create_disk_record(record_store_t *store, char *key, off_t offset,
+        size_t length) {
+    assert(store->disk_fd >= 0);
+    record_t *rec = (record_t *)malloc(sizeof(*rec) + LAZY_SLOTS * sizeof(char *));
+    assert(rec);
+    rec->store = store;
+    charHistogram(key, &rec->key_hist);
+    rec->values[LAZY_KEY_SLOT] = key;
+    // the position is kept in the slots that would hold the row
+    rec->values[DISK_OFFSET_SLOT] = (char *)(uintptr_t)offset;
+    rec->values[DISK_LENGTH_SLOT] = (char *)(uintptr_t)length;
     return rec;
 }
 
 
+/* Helper to read a disk record's row, from the row cache if it is there.
+ * Returns the row in this thread's buffer, valid until its next read.
+ * A row that cannot be read back in full is cut short.
+ */
+static char *disk_row(record_t *rec) {
+    static __thread char *row = NULL;
+    static __thread size_t row_cap = 0;
+
+    record_store_t *store = rec->store;
+    off_t offset = (off_t)(uintptr_t)rec->values[DISK_OFFSET_SLOT];
+    size_t length = (size_t)(uintptr_t)rec->values[DISK_LENGTH_SLOT];
+    if (length + 1 > row_cap) {
+        row = (char *)realloc(row, length + 1);
+        assert(row);
+        row_cap = length + 1;
+    }
+
+    row_cache_t *cache = store->cache;
+    size_t slot = 0;
+    if (cache) {
+        // rows start at scattered offsets, so mix the bits before the modulo
+        slot = ((uint64_t)offset * 0x9E3779B97F4A7C15ull >> 32) % cache->slots;
+        pthread_mutex_lock(&cache->lock);
+        if (cache->offsets[slot] == offset) {
+            memcpy(row, cache->rows[slot], length + 1);
+            pthread_mutex_unlock(&cache->lock);
+            return row;
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = pread(store->disk_fd, row + got, length - got, offset + got);
+        if (n <= 0) break;
+        got += n;
+    }
+    row[got] = '\0';
+    if (!cache || got < length) return row;
+
+    pthread_mutex_lock(&cache->lock);
+    char *copy = (char *)realloc(cache->rows[slot], length + 1);
+    assert(copy);
+    memcpy(copy, row, length + 1);
+    cache->rows[slot] = copy;
+    cache->offsets[slot] = offset;
+    pthread_mutex_unlock(&cache->lock);
+    return row;
+}
+
+
+/* Helper to split a lazy record's row. Returns its NUM_FIELDS fields,
+ * memoized in the record or held in this thread's scratch buffer.
+ */
+static char **lazy_split(record_t *rec) {
+    static __thread char *scratch = NULL;
+    static __thread size_t scratch_cap = 0;
+    static __thread char *scratch_fields[NUM_FIELDS];
+
+    char *row;
+    if (rec->store->disk_fd >= 0) {
+        row = disk_row(rec);
+    } else if (rec->values[LAZY_MEMO_SLOT]) {
+        return (char **)rec->values[LAZY_MEMO_SLOT];
+    } else {
+        row = rec->values[LAZY_ROW_SLOT];
+    }
+    size_t need = strlen(row) + NUM_FIELDS + 1;
+    if (!rec->store->memoize) {
+        if (need > scratch_cap) {
+            scratch = (char *)realloc(scratch, need);
+            assert(scratch);
+            scratch_cap = need;
+        }
+        csv_split_line(row, scratch, scratch_fields, NUM_FIELDS);
+        return scratch_fields;
+    }
+
+    // one block: field pointers followed by the split bytes, row is dropped
+    char **memo = (char **)malloc(NUM_FIELDS * sizeof(char *) + need);
+    assert(memo);
+    csv_split_line(row, (char *)(memo + NUM_FIELDS), memo, NUM_FIELDS);
+    rec->values[LAZY_MEMO_SLOT] = (char *)memo;
+    rec->values[LAZY_ROW_SLOT] = NULL;
+    free(row);
+    return memo;
+}
+
+
+/* Returns one column's value, decoding it if encoded. Non-key values of
+ * lazy records that are not memoized live in a per-thread scratch buffer
+ * and stay valid until the next field access on the same thread.
+ */
+char *record_field(record_t *rec, int i) {
+    record_store_t *store = rec->store;
+    if (store->lazy) {
+        if (i == EZI_ADD_INDEX) return rec->values[LAZY_KEY_SLOT];
+        return lazy_split(rec)[i];
+    }
+    if (store->encoded[i]) {
+        return store->dicts[i].values[record_codes(rec)[store->slot[i]]];
+    }
+    return rec->values[store->slot[i]];
+}
+
+
+/* Fills fields with every column's value, with the same lifetime as
+ * record_field.
+ */
+void record_fields(record_t *rec, char *fields[NUM_FIELDS]) {
+    if (rec->store->lazy) {
+        memcpy(fields, lazy_split(rec), NUM_FIELDS * sizeof(char *));
+        fields[EZI_ADD_INDEX] = rec->values[LAZY_KEY_SLOT];
+        return;
+    }
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        fields[i] = record_field(rec, i);
+    }
+}
+
+
 /* Frees a record and all the strings. */
 void free_record(record_t *rec) {
-    for (int i = 0; i < NUM_FIELDS; i++) {
-        free(rec->fields[i]);
+    if (rec->store->disk_fd >= 0) {
+        // the other slots hold the row's position
+        free(rec->values[LAZY_KEY_SLOT]);
+        free(rec);
+        return;
+    }
+    // encoded values belong to the store
+    for (int i = 0; i < rec->store->plain_count; i++) {
+        free(rec->values[i]);
     }
     free(rec);
 }
 
 
+/* Returns bytes held by a record struct and its field strings. */
+size_t record_memory_bytes(record_t *rec) {
+    record_store_t *store = rec->store;
+    size_t bytes = sizeof(*rec) + store->plain_count * sizeof(char *)
+        + store->coded_count * sizeof(uint32_t);
+    if (store->lazy) {
+        bytes += strlen(rec->values[LAZY_KEY_SLOT]) + 1;
+        if (store->disk_fd >= 0) return bytes;
+        if (rec->values[LAZY_ROW_SLOT]) {
+            bytes += strlen(rec->values[LAZY_ROW_SLOT]) + 1;
+        }
+        char **memo = (char **)rec->values[LAZY_MEMO_SLOT];
+        if (memo) {
+            bytes += NUM_FIELDS * sizeof(char *);
+            for (int i = 0; i < NUM_FIELDS; i++) bytes += strlen(memo[i]) + 1;
+        }
+        return bytes;
+    }
+    for (int i = 0; i < store->plain_count; i++) {
+        bytes += strlen(rec->values[i]) + 1;
+    }
+    return bytes;
+}
+
+
 /* Prints the address record in the required format,
  * where x/y-coordinate fields are rounded and printed to 5 decimals.
  */
 void print_record(FILE *f, record_t *rec, char *headers[NUM_FIELDS]) {
+    char *fields[NUM_FIELDS];
+    record_fields(rec, fields);
+    print_fields(f, fields, headers);
+}
+
+
+/* Prints already decoded fields in the address record format. */
+void print_fields(FILE *f, char *fields[NUM_FIELDS], char *headers[NUM_FIELDS]) {
+    print_projected_fields(f, fields, headers, NULL, NUM_FIELDS);
+}
+
+
+/* Prints count of the decoded fields in the address record format, the
+ * columns listed in indices in that order, or the first count columns
+ * if indices is NULL.
+ */
+void print_projected_fields(FILE *f, char *fields[NUM_FIELDS],
+        char *headers[NUM_FIELDS], int *indices, int count) {
     fprintf(f, "--> ");
 
-    for (int i = 0; i < NUM_FIELDS; i++) {
+    for (int j = 0; j < count; j++) {
+        int i = indices ? indices[j] : j;
         fprintf(f, "%s: ", headers[i]);
 
         // round and print x and y-coords to 5 decimal places
         if ((i == X_COORD_INDEX || i == Y_COORD_INDEX)) {
-            print_rounded_coordinates(f, rec->fields[i]);
+            print_rounded_coordinates(f, fields[i]);
         } else {
             // print other fields as strings
-            fputs(rec->fields[i], f);
+            fputs(fields[i], f);
         }
 
         fprintf(f, " || ");
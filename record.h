@@ -1,6 +1,10 @@
 #ifndef _RECORD_H_
 #define _RECORD_H_
 #include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "edit_dist.h"
 
 
 #define NUM_FIELDS 35    // number of columns/fields for csv
@@ -8,24 +12,131 @@
 #define X_COORD_INDEX 33 // index position for field x-coordinate
 #define Y_COORD_INDEX 34 // index position for field y-coordinate
 
+#define STORE_SAMPLE_ROWS 1024   // rows inspected to choose encoded columns
+#define STORE_SMALL_DISTINCT 16  // always encode columns with this few values
+#define STORE_DISTINCT_RATIO 4   // else encode if rows >= ratio * distinct values
 
-// data type definition for an address record
+// value slots of a lazily materialised record
+#define LAZY_KEY_SLOT 0  // EZI_ADD, parsed at load
+#define LAZY_ROW_SLOT 1  // raw CSV row, NULL once memoized
+#define LAZY_MEMO_SLOT 2 // split fields block once memoized, else NULL
+#define LAZY_SLOTS 3
+#define DISK_OFFSET_SLOT 1 // row's byte offset in the CSV file, for disk records
+#define DISK_LENGTH_SLOT 2 // row's length without the newline, for disk records
+
+#define MAX_ROW_CACHE 65536 // rows kept by the largest row cache
+
+
+// dictionary of the distinct values of one encoded column
+typedef struct {
+    char **values;    // code -> interned string
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *table;  // open addressing hash of code + 1, 0 when empty
+    uint32_t table_cap;
+} column_dict_t;
+
+// direct-mapped cache of rows read back from disk, shared by all threads
+typedef struct {
+    off_t *offsets; // row held by each slot, -1 when empty
+    char **rows;
+    size_t slots;
+    pthread_mutex_t lock;
+} row_cache_t;
+
+// shared layout of all records of a dataset: which columns are encoded
 typedef struct {
-    char *fields[NUM_FIELDS];
+    int encoded[NUM_FIELDS]; // 1 if the column is stored as a code
+    int slot[NUM_FIELDS];    // position among plain values or among codes
+    int plain_count;
+    int coded_count;
+    column_dict_t dicts[NUM_FIELDS];
+    int lazy;    // records keep the raw row and split it on access
+    int memoize; // lazy records keep their fields after the first split
+    int disk_fd; // lazy records read their row from this file, -1 if in memory
+    row_cache_t *cache; // recently read disk rows, NULL for none
+} record_store_t;
+
+// data type definition for an address record, allocated as one block:
+// plain column strings followed by the codes of encoded columns
+typedef struct {
+    record_store_t *store;
+    char_hist_t key_hist; // key's character counts for closest-match bounds
+    char *values[];
 } record_t;
 
 
-/* Creates and returns an empty record. */
-record_t *create_record(char *cols[NUM_FIELDS]);
+/* Creates a store with every column kept as a plain string. */
+record_store_t *create_record_store(void);
+
+/* Chooses which columns to dictionary-encode from sampled rows
+ * (rows * NUM_FIELDS strings). Must be called before any record is created.
+ */
+void store_choose_columns(record_store_t *store, char **sample, int rows);
+
+/* Switches an unused store to lazy records, optionally memoizing the
+ * split fields of each record on first access.
+ */
+void store_set_lazy(record_store_t *store, int memoize);
+
+/* Switches an unused store to lazy records whose rows stay on disk and
+ * are read from fd when accessed, keeping up to cache_rows of them in a
+ * row cache. The store takes ownership of fd.
+ */
+void store_set_disk(record_store_t *store, int fd, size_t cache_rows);
+
+/* Frees the store's column dictionaries and interned strings. */
+void free_record_store(record_store_t *store);
+
+/* Returns bytes held by the store's column dictionaries. */
+size_t store_memory_bytes(record_store_t *store);
+
+/* Creates and returns a record, taking ownership of the column strings. */
+record_t *create_record(record_store_t *store, char *cols[NUM_FIELDS]);
+
+/* Creates a lazy record from its key and raw CSV row, taking ownership
+ * of both strings.
+ */
+record_t *create_lazy_record(record_store_t *store, char *key, char *row);
+
+/* Creates a disk record from its key and its row's position in the
+ * store's file, taking ownership of the key.
+ */
+record_t *create_disk_record(record_store_t *store, char *key, off_t offset,
+    size_t length);
+
+/* Returns one column's value, decoding it if encoded. Non-key values of
+ * lazy records that are not memoized live in a per-thread scratch buffer
+ * and stay valid until the next field access on the same thread.
+ */
+char *record_field(record_t *rec, int i);
+
+/* Fills fields with every column's value, with the same lifetime as
+ * record_field.
+ */
+void record_fields(record_t *rec, char *fields[NUM_FIELDS]);
 
 /* Frees a record and all the strings. */
 void free_record(record_t *rec);
 
+/* Returns bytes held by a record struct and its field strings. */
+size_t record_memory_bytes(record_t *rec);
+
 /* Prints the address record in the required format,
  * where x/y-coordinate fields are rounded and printed to 5 decimals.
  */
 void print_record(FILE *f, record_t *rec, char *headers[NUM_FIELDS]);
 
+/* Prints already decoded fields in the address record format. */
+void print_fields(FILE *f, char *fields[NUM_FIELDS], char *headers[NUM_FIELDS]);
+
+/* Prints count of the decoded fields in the address record format, the
+ * columns listed in indices in that order, or the first count columns
+ * if indices is NULL.
+ */
+void print_projected_fields(FILE *f, char *fields[NUM_FIELDS],
+    char *headers[NUM_FIELDS], int *indices, int count);
+
 /* Helper used by print_record to convert and print x/y rounded to 5 decimal places. */
 void print_rounded_coordinates(FILE *f, char *str);
 
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 
 /* Initialises an empty result with a matches array,
@@ -13,6 +14,12 @@ void initialise_result(result_t *r, size_t match_capacity) {
     r->matches = NULL;
     r->match_count = 0;
     r->bit_cmps = r->node_cmps = r->str_cmps = 0;
+    r->budget.max_candidates = 0;
+    r->budget.max_usec = 0;
+    r->scored = 0;
+    r->deadline_usec = 0;
+    r->clock_skips = 0;
+    r->approximate = 0;
 
     if (match_capacity > 0) {
         r->matches = (record_t**)malloc(match_capacity * sizeof(record_t*));
@@ -29,6 +36,57 @@ void free_result(result_t *r) {
 }
 
 
+/* Empties a result for the next query, keeping its matches array. */
+void clear_result(result_t *r) {
+    r->match_count = 0;
+    r->bit_cmps = r->node_cmps = r->str_cmps = 0;
+    r->scored = 0;
+    r->deadline_usec = 0;
+    r->clock_skips = 0;
+    r->approximate = 0;
+}
+
+
+/* Applies a per-query budget to a result and starts its clock. */
+void result_set_budget(result_t *r, search_budget_t *budget) {
+    r->budget = *budget;
+    r->deadline_usec = budget->max_usec ? now_usec() + budget->max_usec : 0;
+}
+
+
+/* Returns 1 once scored candidates or time exceed the result's budget. */
+int result_budget_spent(result_t *r) {
+    if (r->budget.max_candidates && r->scored >= r->budget.max_candidates) return 1;
+    return r->deadline_usec && now_usec() >= r->deadline_usec;
+}
+
+
+/* Returns 1 and marks the result approximate once its time budget is spent.
+ * Used by collectors to stop gathering candidates, so the clock is only
+ * read on every CLOCK_CHECK_EVERY-th call.
+ */
+int result_out_of_time(result_t *r) {
+    if (r->approximate) return 1;
+    if (!r->deadline_usec) return 0;
+    if (r->clock_skips > 0) {
+        r->clock_skips--;
+        return 0;
+    }
+    r->clock_skips = CLOCK_CHECK_EVERY - 1;
+    if (now_usec() < r->deadline_usec) return 0;
+    r->approximate = 1;
+    return 1;
+}
+
+
+/* Returns a monotonic timestamp in microseconds. */
+long now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+
 /* Creates an empty result_t and initialises. */
 result_t *create_result(size_t match_capacity) {
     result_t *result = (result_t*)malloc(sizeof(*result));
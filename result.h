@@ -4,8 +4,15 @@
 
 
 #define MISMATCH_BIT 1 // additional count for the mismatching bit
+#define CLOCK_CHECK_EVERY 64 // time checks per read of the clock
 
 
+// type definition for per-query limits on closest-match scoring, 0 for none
+typedef struct {
+    int max_candidates; // distinct candidate keys scored
+    long max_usec;      // microseconds from the start of the search
+} search_budget_t;
+
 // type definition for searched matching results
 typedef struct {
     record_t **matches;
@@ -13,6 +20,11 @@ typedef struct {
     int bit_cmps;
     int node_cmps;
     int str_cmps; 
+    search_budget_t budget;
+    int scored;         // candidate keys scored so far by every ranking
+    long deadline_usec; // end of the time budget, 0 if none
+    int clock_skips;    // time checks left before the clock is read again
+    int approximate;    // 1 if the budget ran out before the best key was certain
 } result_t;
 
 
@@ -24,6 +36,24 @@ void initialise_result(result_t *r, size_t match_capacity);
 /* Frees the matches array and reset counters to 0. */
 void free_result(result_t *r);
 
+/* Empties a result for the next query, keeping its matches array. */
+void clear_result(result_t *r);
+
+/* Applies a per-query budget to a result and starts its clock. */
+void result_set_budget(result_t *r, search_budget_t *budget);
+
+/* Returns 1 once scored candidates or time exceed the result's budget. */
+int result_budget_spent(result_t *r);
+
+/* Returns 1 and marks the result approximate once its time budget is spent.
+ * Used by collectors to stop gathering candidates, so the clock is only
+ * read on every CLOCK_CHECK_EVERY-th call.
+ */
+int result_out_of_time(result_t *r);
+
+/* Returns a monotonic timestamp in microseconds. */
+long now_usec(void);
+
 /* Creates an empty result_t and initialises. */
 result_t *create_result(size_t match_capacity);
 
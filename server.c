@@ -0,0 +1,518 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "protocol.h"
+#include "loader.h"
+#include "record.h"
+#include "result.h"
+
+
+// per-client state, owned by the event loop
+typedef struct connection {
+    int fd;
+    buffer_t in;
+    buffer_t out;
+    int reading; // 0 while paused for output backpressure
+    struct connection *prev; // open connections, to close them at shutdown
+    struct connection *next;
+} connection_t;
+
+// background rebuild started by SIGHUP, handed back to the loop by done_fd
+typedef struct {
+    char *csv_path;
+    options_t *opts;
+    int done_fd;        // eventfd written once fresh is set
+    pthread_t thread;
+    int running;
+    tree_dict_t *fresh; // the new dictionary, NULL if the load failed
+    tree_dict_t *old;   // the replaced dictionary while it is being freed
+    int retired_fd;     // eventfd written once old is freed
+    int retiring;       // 1 until retired_fd has been read
+} reload_t;
+
+// tags told apart from connections in epoll data
+static int listener_tag;
+static int signal_tag;
+static int reload_tag;
+static int retire_tag;
+
+
+/* Helper to make a descriptor non-blocking. */
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+/* Creates the listening socket at path, replacing a stale socket file. */
+static int open_listener(char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(fd, SERVER_BACKLOG) < 0 || set_nonblocking(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/* Appends one record as NUM_FIELDS length-prefixed strings. */
+static void put_record(buffer_t *out, char *fields[NUM_FIELDS]) {
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        size_t len = strlen(fields[i]);
+        buffer_put_u16(out, len);
+        buffer_append(out, fields[i], len);
+    }
+}
+
+
+/* Runs one request against the dictionary and appends its response frame. */
+static void handle_request(tree_dict_t *dict, search_budget_t *budget,
+        char *body, size_t body_len, buffer_t *out) {
+    size_t frame_start = out->len;
+    buffer_put_u32(out, 0); // patched once the body is written
+
+    if (body_len < PROTO_REQUEST_FIXED) {
+        buffer_put_u8(out, STATUS_BAD_REQUEST);
+        buffer_put_u32(out, 0);
+        for (int i = 0; i < 4; i++) buffer_put_u32(out, 0);
+        buffer_set_u32(out, frame_start, out->len - frame_start - PROTO_LEN_BYTES);
+        return;
+    }
+
+    uint8_t op = (uint8_t)body[0];
+    uint32_t id = get_u32(body + 1);
+    size_t key_len = body_len - PROTO_REQUEST_FIXED;
+    char *key = (char *)malloc(key_len + 1);
+    assert(key);
+    memcpy(key, body + PROTO_REQUEST_FIXED, key_len);
+    key[key_len] = '\0';
+
+    result_t *result = create_result(dict->size);
+    result_set_budget(result, budget);
+    int status = STATUS_OK;
+    switch (op) {
+        case OP_EXACT:
+            dict_exact_search(dict, key, result);
+            break;
+        case OP_CLOSEST:
+            dict_search(dict, key, result);
+            break;
+        case OP_PREFIX:
+            dict_prefix_search(dict, key, result);
+            break;
+        case OP_HEADERS:
+            break;
+        default:
+            status = STATUS_BAD_REQUEST;
+    }
+    if (status == STATUS_OK && op != OP_HEADERS && result->match_count == 0) {
+        status = STATUS_NOTFOUND;
+    } else if (status == STATUS_OK && result->approximate) {
+        status = STATUS_APPROXIMATE;
+    }
+
+    buffer_put_u8(out, status);
+    buffer_put_u32(out, id);
+    buffer_put_u32(out, op == OP_HEADERS ? 1 : result->match_count);
+    buffer_put_u32(out, result->bit_cmps);
+    buffer_put_u32(out, result->node_cmps);
+    buffer_put_u32(out, result->str_cmps);
+    if (op == OP_HEADERS) {
+        put_record(out, dict->headers);
+    } else {
+        for (int i = 0; i < result->match_count; i++) {
+            char *fields[NUM_FIELDS];
+            record_fields(result->matches[i], fields);
+            put_record(out, fields);
+        }
+    }
+    buffer_set_u32(out, frame_start, out->len - frame_start - PROTO_LEN_BYTES);
+
+    free_result(result);
+    free(result);
+    free(key);
+}
+
+
+/* Closes a connection, unlinks it from conns and frees its buffers. */
+static void close_connection(int epfd, connection_t **conns, connection_t *conn) {
+    if (conn->prev) conn->prev->next = conn->next;
+    else *conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    buffer_free(&conn->in);
+    buffer_free(&conn->out);
+    free(conn);
+}
+
+
+/* Updates which events the loop waits for on a connection. */
+static void watch_connection(int epfd, connection_t *conn) {
+    struct epoll_event ev;
+    ev.events = (conn->reading ? EPOLLIN : 0) | (conn->out.len ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+
+/* Answers every complete frame buffered on the connection, stopping early
+ * when too much output is queued. Returns 0 on a protocol error, including
+ * a frame longer than SERVER_MAX_INPUT.
+ */
+static int process_frames(tree_dict_t *dict, search_budget_t *budget,
+        connection_t *conn, size_t *served) {
+    size_t offset = 0;
+    while (conn->out.len < SERVER_OUT_HIGH_WATER) {
+        buffer_t view = { conn->in.data + offset, conn->in.len - offset, 0 };
+        long body_len = proto_frame_ready(&view, PROTO_MAX_REQUEST);
+        if (body_len < 0) return 0;
+        if (body_len == 0) break;
+
+        handle_request(dict, budget, view.data + PROTO_LEN_BYTES, body_len,
+            &conn->out);
+        offset += PROTO_LEN_BYTES + body_len;
+        (*served)++;
+    }
+    buffer_consume(&conn->in, offset);
+    conn->reading = conn->out.len < SERVER_OUT_HIGH_WATER;
+    return 1;
+}
+
+
+/* Writes as much queued output as the socket takes. Returns 0 on any
+ * write error, after which the connection can only be closed.
+ */
+static int flush_connection(connection_t *conn) {
+    size_t sent = 0;
+    while (sent < conn->out.len) {
+        ssize_t n = write(conn->fd, conn->out.data + sent, conn->out.len - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return 0;
+        sent += n;
+    }
+    buffer_consume(&conn->out, sent);
+    return 1;
+}
+
+
+/* Reads what is available on a connection, up to SERVER_MAX_INPUT
+ * buffered bytes; the rest is read once frames have been consumed.
+ * Returns 1 if the peer may send more, 0 on EOF and -1 on error.
+ */
+static int fill_connection(connection_t *conn) {
+    while (conn->in.len < SERVER_MAX_INPUT) {
+        size_t room = SERVER_MAX_INPUT - conn->in.len;
+        if (room > SERVER_READ_CHUNK) room = SERVER_READ_CHUNK;
+        buffer_reserve(&conn->in, room);
+        ssize_t n = read(conn->fd, conn->in.data + conn->in.len, room);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+        if (n < 0) return -1;
+        if (n == 0) return 0;
+        conn->in.len += n;
+    }
+    return 1;
+}
+
+
+/* Accepts all pending clients, registers them with the loop and links
+ * them into conns.
+ */
+static void accept_connections(int epfd, int listen_fd, connection_t **conns) {
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        if (set_nonblocking(fd) < 0) {
+            close(fd);
+            continue;
+        }
+
+        connection_t *conn = (connection_t *)malloc(sizeof(*conn));
+        assert(conn);
+        conn->fd = fd;
+        conn->reading = 1;
+        buffer_init(&conn->in);
+        buffer_init(&conn->out);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        conn->prev = NULL;
+        conn->next = *conns;
+        if (*conns) (*conns)->prev = conn;
+        *conns = conn;
+    }
+}
+
+
+/* Builder thread: loads the new dictionary, then wakes the event loop. */
+static void *reload_thread(void *arg) {
+    reload_t *reload = (reload_t *)arg;
+    reload->fresh = load_tree_dict(reload->csv_path, reload->opts);
+    uint64_t one = 1;
+    ssize_t n = write(reload->done_fd, &one, sizeof(one));
+    assert(n == sizeof(one)); // one write per reload cannot overflow the counter
+    return NULL;
+}
+
+
+/* Detached retire thread: frees a replaced dictionary off the event loop,
+ * then wakes the loop.
+ */
+static void *retire_thread(void *arg) {
+    reload_t *reload = (reload_t *)arg;
+    free_tree(reload->old);
+    uint64_t one = 1;
+    ssize_t n = write(reload->retired_fd, &one, sizeof(one));
+    assert(n == sizeof(one)); // one write per retire cannot overflow the counter
+    return NULL;
+}
+
+
+/* Helper to note that the retire thread has freed the old dictionary,
+ * once retired_fd is readable. With wait set, blocks until then.
+ */
+static void finish_retire(reload_t *reload, int wait) {
+    if (!reload->retiring) return;
+    if (wait) {
+        struct pollfd pfd = { reload->retired_fd, POLLIN, 0 };
+        while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {}
+    }
+    uint64_t count;
+    if (read(reload->retired_fd, &count, sizeof(count)) != sizeof(count)) return;
+    reload->old = NULL;
+    reload->retiring = 0;
+}
+
+
+/* Starts rebuilding the dictionary from the reload's csv_path on its own
+ * thread, unless a rebuild is already running or the dictionary replaced
+ * by the last one is still being freed. Requests keep being served from
+ * the current dictionary meanwhile.
+ */
+static void start_reload(reload_t *reload, FILE *log_fp) {
+    // at most two dictionaries besides the one being built
+    if (reload->running) {
+        fprintf(log_fp, "reload already running\n");
+    } else if (reload->retiring) {
+        fprintf(log_fp, "reload refused: previous dictionary still being freed\n");
+    } else if (pthread_create(&reload->thread, NULL, reload_thread, reload) != 0) {
+        fprintf(log_fp, "reload failed: %s\n", reload->csv_path);
+    } else {
+        reload->running = 1;
+        fprintf(log_fp, "reload started: %s\n", reload->csv_path);
+    }
+    fflush(log_fp);
+}
+
+
+/* Swaps in the dictionary built by the finished reload, keeping the old one
+ * if the load failed. Responses are serialised into the connection buffers
+ * when their request is handled, so no request still refers to the old
+ * dictionary and it is freed straight away, on a detached thread that
+ * reports back through retired_fd.
+ */
+static void finish_reload(reload_t *reload, tree_dict_t **dict, FILE *log_fp) {
+    uint64_t count;
+    if (read(reload->done_fd, &count, sizeof(count)) != sizeof(count)) return;
+    pthread_join(reload->thread, NULL);
+    reload->running = 0;
+
+    if (!reload->fresh) {
+        fprintf(log_fp, "reload failed: %s\n", reload->csv_path);
+        fflush(log_fp);
+        return;
+    }
+    reload->old = *dict;
+    *dict = reload->fresh;
+    reload->fresh = NULL;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, retire_thread, reload) == 0) {
+        reload->retiring = 1;
+    } else {
+        free_tree(reload->old);
+        reload->old = NULL;
+    }
+    pthread_attr_destroy(&attr);
+    fprintf(log_fp, "reloaded %zu records\n", (*dict)->size);
+    fflush(log_fp);
+}
+
+
+/* Serves pipelined exact, closest and prefix requests on a Unix socket
+ * from one epoll event loop until SIGINT or SIGTERM. SIGHUP rebuilds the
+ * dictionary from opts->reload_path (csv_path if NULL) on a background
+ * thread and swaps it in between requests, keeping the old one if the
+ * reload fails. A SIGHUP while the last replaced dictionary is still
+ * being freed is refused. Server events are logged to log_fp.
+ * Returns 0 on clean shutdown, 1 if the socket could not be set up.
+ */
+int run_server(char *socket_path, char *csv_path, options_t *opts,
+        tree_dict_t **dict, FILE *log_fp) {
+    int listen_fd = open_listener(socket_path);
+    if (listen_fd < 0) return 1;
+
+    // deliver signals through the loop instead of handlers
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK);
+
+    reload_t reload;
+    reload.csv_path = opts->reload_path ? opts->reload_path : csv_path;
+    reload.opts = opts;
+    reload.done_fd = eventfd(0, EFD_NONBLOCK);
+    reload.running = 0;
+    reload.fresh = NULL;
+    reload.old = NULL;
+    reload.retired_fd = eventfd(0, EFD_NONBLOCK);
+    reload.retiring = 0;
+
+    int epfd = epoll_create1(0);
+    if (sig_fd < 0 || reload.done_fd < 0 || reload.retired_fd < 0 || epfd < 0) {
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listener_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.ptr = &signal_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sig_fd, &ev);
+    ev.data.ptr = &reload_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, reload.done_fd, &ev);
+    ev.data.ptr = &retire_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, reload.retired_fd, &ev);
+
+    fprintf(log_fp, "serving %zu records on %s\n", (*dict)->size, socket_path);
+    fflush(log_fp);
+
+    search_budget_t budget = { opts->max_candidates, opts->max_usec };
+    connection_t *conns = NULL;
+    size_t served = 0;
+    int running = 1;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (running) {
+        int ready = epoll_wait(epfd, events, SERVER_MAX_EVENTS, -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+
+        for (int i = 0; i < ready; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listener_tag) {
+                accept_connections(epfd, listen_fd, &conns);
+                continue;
+            }
+            if (tag == &signal_tag) {
+                struct signalfd_siginfo info;
+                while (read(sig_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGHUP) {
+                        start_reload(&reload, log_fp);
+                    } else {
+                        running = 0;
+                    }
+                }
+                continue;
+            }
+            if (tag == &reload_tag) {
+                finish_reload(&reload, dict, log_fp);
+                continue;
+            }
+            if (tag == &retire_tag) {
+                finish_retire(&reload, 0);
+                continue;
+            }
+
+            connection_t *conn = (connection_t *)tag;
+            int ok = 1;   // peer may still send requests
+            int dead = 0; // nothing more can be written either
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) dead = 1;
+            if (!dead && (events[i].events & EPOLLIN)) {
+                int filled = fill_connection(conn);
+                if (filled < 0) dead = 1;
+                else if (filled == 0) ok = 0;
+            }
+            // answer buffered requests even if the client already half-closed
+            if (!dead && conn->in.len
+                    && !process_frames(*dict, &budget, conn, &served)) {
+                dead = 1;
+            }
+            if (!dead && !flush_connection(conn)) dead = 1;
+            if (!dead && ok && !conn->reading
+                    && conn->out.len < SERVER_OUT_HIGH_WATER) {
+                // backlog drained, resume reading and parsing
+                if (!process_frames(*dict, &budget, conn, &served)
+                        || !flush_connection(conn)) {
+                    dead = 1;
+                }
+            }
+
+            if (dead || (!ok && !conn->out.len)) {
+                close_connection(epfd, &conns, conn);
+            } else if (!ok) {
+                // peer done sending, still drain what we owe it
+                conn->reading = 0;
+                watch_connection(epfd, conn);
+            } else {
+                watch_connection(epfd, conn);
+            }
+        }
+    }
+
+    while (conns) close_connection(epfd, &conns, conns);
+    if (reload.running) {
+        // a rebuild in progress is finished and dropped
+        pthread_join(reload.thread, NULL);
+        if (reload.fresh) free_tree(reload.fresh);
+    }
+    finish_retire(&reload, 1);
+    fprintf(log_fp, "shutdown after %zu requests\n", served);
+    close(reload.done_fd);
+    close(reload.retired_fd);
+    close(epfd);
+    close(sig_fd);
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+#include <stdio.h>
+#include "tree.h"
+#include "options.h"
+#include "protocol.h"
+
+
+#define SERVER_BACKLOG 128            // pending connections on the listener
+#define SERVER_MAX_EVENTS 64          // epoll events handled per wakeup
+#define SERVER_READ_CHUNK 16384       // bytes read per read() call
+#define SERVER_OUT_HIGH_WATER (4 << 20) // stop reading a client above this backlog
+#define SERVER_MAX_INPUT (PROTO_LEN_BYTES + PROTO_MAX_REQUEST) // unparsed bytes buffered
+
+
+/* Serves pipelined exact, closest and prefix requests on a Unix socket
+ * from one epoll event loop until SIGINT or SIGTERM. SIGHUP rebuilds the
+ * dictionary from opts->reload_path (csv_path if NULL) on a background
+ * thread and swaps it in between requests, keeping the old one if the
+ * reload fails. Server events are logged to log_fp.
+ * Returns 0 on clean shutdown, 1 if the socket could not be set up.
+ */
+int run_server(char *socket_path, char *csv_path, options_t *opts,
+    tree_dict_t **dict, FILE *log_fp);
+
+
+#endif
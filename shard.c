@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "shard.h"
+#include "edit_dist.h"
+#include "hash.h"
+
+
+#define SHARD_PREFIX_BYTES 2 // leading key bytes used for prefix sharding
+#define SHARD_MAX_NODES 64   // NUMA nodes looked for in sysfs
+#define SHARD_NODE_CPULIST "/sys/devices/system/node/node%d/cpulist"
+
+
+// per-thread work for building one shard
+typedef struct {
+    tree_dict_t *shard;
+    record_t **records;
+    size_t count;
+    int cpu; // CPU to pin to, or -1
+} shard_job_t;
+
+// a thread's reusable result for the per-shard searches of shard_search
+typedef struct {
+    result_t result;
+    size_t capacity;
+} shard_scratch_t;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+
+/* Returns the shard a key belongs to. */
+int shard_of(tree_dict_t *dict, char *key) {
+    size_t len = strlen(key);
+    uint32_t h;
+
+    if (dict->shard_by == SHARD_BY_POSTCODE) {
+        // hash the last space separated token
+        char *last = strrchr(key, ' ');
+        char *token = last ? last + 1 : key;
+        h = hash_bytes(token, len - (token - key));
+    } else {
+        h = hash_bytes(key, len < SHARD_PREFIX_BYTES ? len : SHARD_PREFIX_BYTES);
+    }
+    return h % dict->num_shards;
+}
+
+
+/* Thread body inserting one shard's records. */
+static void *build_shard(void *arg) {
+    shard_job_t *job = (shard_job_t *)arg;
+
+    if (job->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(job->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    for (size_t i = 0; i < job->count; i++) {
+        insert_tree(job->shard, get_record_key(job->records[i]), job->records[i]);
+    }
+    tree_finalise(job->shard);
+    return NULL;
+}
+
+
+/* Helper to read up to max CPU numbers of NUMA node node from its sysfs
+ * cpulist (ranges such as "0-3,8-11"). Returns how many were read, 0 if
+ * the node does not exist or has no CPUs.
+ */
+static int read_node_cpus(int node, int *cpus, int max) {
+    char path[64], list[4096];
+    snprintf(path, sizeof(path), SHARD_NODE_CPULIST, node);
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+
+    int count = 0;
+    if (fgets(list, sizeof(list), f)) {
+        for (char *p = list; count < max; p++) {
+            char *end;
+            long first = strtol(p, &end, 10);
+            if (end == p) break;
+            long last = first;
+            if (*end == '-') last = strtol(end + 1, &end, 10);
+            for (long cpu = first; cpu <= last && count < max; cpu++) {
+                cpus[count++] = cpu;
+            }
+            p = end;
+            if (*p != ',') break;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+
+/* Helper to choose a CPU for each shard's build thread: shards go round
+ * robin over the NUMA nodes that have CPUs, and round robin over each
+ * node's CPUs. Without NUMA information all online CPUs form one node.
+ */
+static void place_shards(int num_shards, int cpu[MAX_SHARDS]) {
+    // no node needs more than one CPU per shard
+    int node_cpus[SHARD_MAX_NODES][MAX_SHARDS];
+    int sizes[SHARD_MAX_NODES];
+    int nodes = 0;
+    for (int n = 0; n < SHARD_MAX_NODES; n++) {
+        sizes[nodes] = read_node_cpus(n, node_cpus[nodes], MAX_SHARDS);
+        if (sizes[nodes]) nodes++;
+    }
+
+    if (!nodes) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        sizes[0] = online < 1 ? 1 : online > MAX_SHARDS ? MAX_SHARDS : online;
+        for (int i = 0; i < sizes[0]; i++) node_cpus[0][i] = i;
+        nodes = 1;
+    }
+
+    for (int s = 0; s < num_shards; s++) {
+        int n = s % nodes;
+        cpu[s] = node_cpus[n][(s / nodes) % sizes[n]];
+    }
+}
+
+
+/* Partitions records into num_shards independent trees of the dictionary's
+ * index type and builds them in parallel, one thread per shard. When pin is
+ * set, build threads are spread over the NUMA nodes in sysfs and pinned to
+ * a CPU there, so a shard's nodes are first touched (and so allocated) on
+ * that CPU's memory node.
+ */
+void shard_dict_build(tree_dict_t *dict, record_t **records, size_t count,
+        int num_shards, int shard_by, int pin) {
+    assert(num_shards > 0 && num_shards <= MAX_SHARDS);
+    dict->num_shards = num_shards;
+    dict->shard_by = shard_by;
+    dict->shards = (tree_dict_t **)malloc(num_shards * sizeof(*dict->shards));
+    assert(dict->shards);
+
+    // shards share the top dictionary's headers and record store,
+    // so own neither themselves
+    char *no_headers[NUM_FIELDS] = { NULL };
+    shard_job_t jobs[MAX_SHARDS];
+    size_t filled[MAX_SHARDS] = { 0 };
+    int cpu[MAX_SHARDS];
+    if (pin) place_shards(num_shards, cpu);
+
+    for (int s = 0; s < num_shards; s++) {
+        dict->shards[s] = create_tree_dict(no_headers, dict->index_type);
+        free_record_store(dict->shards[s]->store);
+        dict->shards[s]->store = NULL;
+        jobs[s].shard = dict->shards[s];
+        jobs[s].count = 0;
+        jobs[s].cpu = pin ? cpu[s] : -1;
+    }
+
+    // bucket records by shard
+    int *owner = (int *)malloc((count + 1) * sizeof(*owner));
+    assert(owner);
+    for (size_t i = 0; i < count; i++) {
+        owner[i] = shard_of(dict, get_record_key(records[i]));
+        jobs[owner[i]].count++;
+    }
+    for (int s = 0; s < num_shards; s++) {
+        jobs[s].records = (record_t **)malloc((jobs[s].count + 1) * sizeof(record_t *));
+        assert(jobs[s].records);
+    }
+    for (size_t i = 0; i < count; i++) {
+        jobs[owner[i]].records[filled[owner[i]]++] = records[i];
+    }
+    free(owner);
+
+    // build every shard on its own thread
+    pthread_t threads[MAX_SHARDS];
+    for (int s = 0; s < num_shards; s++) {
+        int err = pthread_create(&threads[s], NULL, build_shard, &jobs[s]);
+        assert(err == 0);
+    }
+    for (int s = 0; s < num_shards; s++) {
+        pthread_join(threads[s], NULL);
+        free(jobs[s].records);
+        if (dict->shards[s]->size > dict->shard_max_size) {
+            dict->shard_max_size = dict->shards[s]->size;
+        }
+    }
+    dict->size += count;
+}
+
+
+/* Helper to free a thread's scratch result when the thread exits. */
+static void free_scratch(void *arg) {
+    shard_scratch_t *scratch = (shard_scratch_t *)arg;
+    free_result(&scratch->result);
+    free(scratch);
+}
+
+
+/* Helper to create the key of the per-thread scratch results. */
+static void create_scratch_key(void) {
+    int err = pthread_key_create(&scratch_key, free_scratch);
+    assert(err == 0);
+}
+
+
+/* Helper to return the calling thread's scratch result, emptied and with
+ * room for at least capacity matches.
+ */
+static result_t *get_scratch(size_t capacity) {
+    pthread_once(&scratch_once, create_scratch_key);
+    shard_scratch_t *scratch = (shard_scratch_t *)pthread_getspecific(scratch_key);
+    if (!scratch) {
+        scratch = (shard_scratch_t *)malloc(sizeof(*scratch));
+        assert(scratch);
+        initialise_result(&scratch->result, capacity);
+        scratch->capacity = capacity;
+        pthread_setspecific(scratch_key, scratch);
+    } else if (scratch->capacity < capacity) {
+        // a reloaded dictionary can have larger shards
+        free_result(&scratch->result);
+        initialise_result(&scratch->result, capacity);
+        scratch->capacity = capacity;
+    }
+    clear_result(&scratch->result);
+    return &scratch->result;
+}
+
+
+/* Exact match routes to the key's shard. On a miss, closest match fans
+ * out over all shards and keeps the shard winner with minimum edit
+ * distance, alphabetically earliest on ties. The shards share the query's
+ * budget; once it is spent the remaining shards are skipped and the
+ * result is marked approximate. Returns 1 if key was found.
+ */
+int shard_search(tree_dict_t *dict, char *key, result_t *result) {
+    int home = shard_of(dict, key);
+    int init_count = result->match_count;
+    char *best_key = NULL;
+    int best_dist = 0;
+
+    // every shard is searched in the same scratch result
+    result_t *part = get_scratch(dict->shard_max_size);
+
+    for (int i = 0; i < dict->num_shards; i++) {
+        // home shard first, so an exact hit never fans out
+        int s = (home + i) % dict->num_shards;
+        if (best_key && result_budget_spent(result)) {
+            result->approximate = 1;
+            break;
+        }
+        clear_result(part);
+        part->budget = result->budget;
+        part->scored = result->scored;
+        part->deadline_usec = result->deadline_usec;
+        dict_search(dict->shards[s], key, part);
+
+        result->scored = part->scored;
+        result->bit_cmps += part->bit_cmps;
+        result->node_cmps += part->node_cmps;
+        result->str_cmps += part->str_cmps;
+        result->approximate |= part->approximate;
+        if (!part->match_count) continue;
+
+        char *cand = get_record_key(part->matches[0]);
+        int exact = (s == home && strcmp(cand, key) == 0);
+        int dist = exact ? 0 : editDistance(key, cand, strlen(key), strlen(cand));
+
+        // keep this shard's records if it beats the best so far
+        if (exact || !best_key || dist < best_dist ||
+            (dist == best_dist && strcmp(cand, best_key) < 0)) {
+            best_key = cand;
+            best_dist = dist;
+            memcpy(result->matches + init_count, part->matches,
+                part->match_count * sizeof(record_t *));
+            result->match_count = init_count + part->match_count;
+        }
+        if (exact) return 1;
+    }
+    return 0;
+}
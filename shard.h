@@ -0,0 +1,35 @@
+#ifndef _SHARD_H_
+#define _SHARD_H_
+#include <stddef.h>
+#include "tree.h"
+#include "record.h"
+#include "result.h"
+
+
+#define MAX_SHARDS 64      // upper bound for --shards
+#define SHARD_BY_PREFIX 0   // partition on the key's leading bytes
+#define SHARD_BY_POSTCODE 1 // partition on the key's trailing postcode token
+
+
+/* Returns the shard a key belongs to. */
+int shard_of(tree_dict_t *dict, char *key);
+
+/* Partitions records into num_shards independent trees of the dictionary's
+ * index type and builds them in parallel, one thread per shard. When pin is
+ * set, build threads are spread over the NUMA nodes in sysfs and pinned to
+ * a CPU there, so a shard's nodes are first touched (and so allocated) on
+ * that CPU's memory node.
+ */
+void shard_dict_build(tree_dict_t *dict, record_t **records, size_t count,
+    int num_shards, int shard_by, int pin);
+
+/* Exact match routes to the key's shard. On a miss, closest match fans
+ * out over all shards and keeps the shard winner with minimum edit
+ * distance, alphabetically earliest on ties. The shards share the query's
+ * budget; once it is spent the remaining shards are skipped and the
+ * result is marked approximate. Returns 1 if key was found.
+ */
+int shard_search(tree_dict_t *dict, char *key, result_t *result);
+
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "stats.h"
+#include "bit.h"
+#include "shard.h"
+
+
+/* Helper returning the power-of-two bucket of a count: 0, 1, 2-3, 4-7, ... */
+static int log_bucket(size_t value) {
+    int bucket = 0;
+    while (value && bucket < STATS_LOG_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+/* Helper to count records held by a subtree. */
+static size_t subtree_records(tree_node_t *node) {
+    if (!node) return 0;
+    size_t count = 0;
+    for (node_rec_t *nrec = node->head; nrec; nrec = nrec->next) count++;
+    return count + subtree_records(node->left) + subtree_records(node->right);
+}
+
+
+/* Visits a subtree at depth (root is 1, the n of a search stopping there)
+ * and returns its record count.
+ */
+static size_t walk_node(tree_stats_t *stats, tree_node_t *node, int depth) {
+    if (!node) return 0;
+    size_t own = 0;
+    for (node_rec_t *nrec = node->head; nrec; nrec = nrec->next) own++;
+    size_t total = own + walk_node(stats, node->left, depth + 1)
+        + walk_node(stats, node->right, depth + 1);
+
+    depth_stats_t *d = &stats->depth[depth < STATS_MAX_DEPTH ? depth : STATS_MAX_DEPTH];
+    d->nodes++;
+    d->subtree_records += total;
+    if (total > d->max_subtree) d->max_subtree = total;
+
+    stats->nodes++;
+    if (depth > stats->max_depth) stats->max_depth = depth;
+    stats->prefix_hist[log_bucket(node->prefix_bits)]++;
+    if (own) {
+        stats->record_nodes++;
+        stats->records_hist[log_bucket(own)]++;
+    }
+    return total;
+}
+
+
+/* Walks the dictionary's Patricia tree (or every shard's) and fills the
+ * depth, prefix length, records per node and subtree size figures.
+ */
+void stats_collect_tree(tree_stats_t *stats, tree_dict_t *dict) {
+    memset(stats, 0, sizeof(*stats));
+    if (dict->index_type != INDEX_PATRICIA) return;
+    stats->available = 1;
+
+    if (dict->num_shards) {
+        for (int s = 0; s < dict->num_shards; s++) {
+            walk_node(stats, dict->shards[s]->root, 1);
+        }
+    } else {
+        walk_node(stats, dict->root, 1);
+    }
+}
+
+
+/* Repeats a search's descent without counters, returning the node it
+ * stopped at with its depth, and the first mismatching key bit (-1 when
+ * the key was found).
+ */
+static tree_node_t *profile_descent(tree_node_t *node, char *key, int *depth,
+        int *mismatch_bit) {
+    int total_bits = get_total_bits(key);
+    int curr_bit = START_BIT;
+    tree_node_t *last = NULL;
+    *depth = 0;
+    *mismatch_bit = -1;
+
+    while (node) {
+        (*depth)++;
+        last = node;
+        int match = compare_prefix_bits(key, curr_bit, total_bits,
+            node->prefix, node->prefix_bits);
+        if (match < node->prefix_bits) {
+            *mismatch_bit = curr_bit + match;
+            return node;
+        }
+        curr_bit += node->prefix_bits;
+        if (curr_bit >= total_bits) return node;
+        node = getBit(key, curr_bit) ? node->right : node->left;
+    }
+    // fell off below last, the branch bit had no child
+    *mismatch_bit = curr_bit;
+    return last;
+}
+
+
+/* Helper keeping the STATS_TOP_QUERIES slowest queries, slowest first. */
+static void keep_if_expensive(tree_stats_t *stats, query_cost_t *cost) {
+    int pos = stats->top_count;
+    while (pos > 0 && stats->top[pos - 1].usec < cost->usec) pos--;
+    if (pos >= STATS_TOP_QUERIES) return;
+
+    if (stats->top_count == STATS_TOP_QUERIES) {
+        free(stats->top[STATS_TOP_QUERIES - 1].key);
+    } else {
+        stats->top_count++;
+    }
+    memmove(&stats->top[pos + 1], &stats->top[pos],
+        (stats->top_count - pos - 1) * sizeof(query_cost_t));
+    stats->top[pos] = *cost;
+    stats->top[pos].key = strdup(cost->key);
+    assert(stats->top[pos].key);
+}
+
+
+/* Adds one searched query: its time, counters and the depth and key byte
+ * where its descent stopped, charged to that depth.
+ */
+void stats_record_query(tree_stats_t *stats, tree_dict_t *dict, char *key,
+        result_t *result, long usec) {
+    query_cost_t cost = { key, usec, result->bit_cmps, result->node_cmps,
+        result->str_cmps, 0, -1, 0, result->approximate };
+    stats->queries++;
+    stats->usec += usec;
+    stats->approximate += result->approximate;
+    stats->budget = result->budget;
+
+    if (stats->available) {
+        // sharded lookups are profiled on the key's home shard
+        tree_node_t *root = dict->num_shards
+            ? dict->shards[shard_of(dict, key)]->root : dict->root;
+        int mismatch_bit;
+        tree_node_t *end = profile_descent(root, key, &cost.depth, &mismatch_bit);
+
+        depth_stats_t *d = &stats->depth[cost.depth < STATS_MAX_DEPTH
+            ? cost.depth : STATS_MAX_DEPTH];
+        d->queries++;
+        d->usec += usec;
+        if (mismatch_bit < 0) {
+            stats->exact++;
+        } else if (end) {
+            cost.mismatch_byte = mismatch_bit / BITS_PER_BYTE;
+            cost.candidates = subtree_records(end);
+            d->mismatches++;
+            d->candidates += cost.candidates;
+        }
+    }
+    keep_if_expensive(stats, &cost);
+}
+
+
+/* Helper to print a power-of-two histogram on one line. */
+static void print_log_hist(FILE *f, char *name, size_t hist[STATS_LOG_BUCKETS]) {
+    fprintf(f, "%s:", name);
+    for (int b = 0; b < STATS_LOG_BUCKETS; b++) {
+        if (!hist[b]) continue;
+        if (b < 2) {
+            fprintf(f, " %d:%zu", b, hist[b]);
+        } else {
+            fprintf(f, " %ld-%ld:%zu", 1L << (b - 1), (1L << b) - 1, hist[b]);
+        }
+    }
+    fputc('\n', f);
+}
+
+
+/* Prints the tree shape and query cost report. */
+void print_tree_stats(FILE *f, tree_stats_t *stats) {
+    if (!stats->available) {
+        fputs("tree stats: shape is only reported for the patricia index\n", f);
+    } else {
+        fprintf(f, "tree stats: %zu nodes, %zu with records, max depth %d\n",
+            stats->nodes, stats->record_nodes, stats->max_depth);
+        print_log_hist(f, "prefix bits", stats->prefix_hist);
+        print_log_hist(f, "records per node", stats->records_hist);
+
+        // depth is the node count n of a search stopping there
+        fprintf(f, "%5s %8s %12s %12s %8s %10s %14s %10s\n", "depth", "nodes",
+            "avg_subtree", "max_subtree", "queries", "mismatches",
+            "avg_candidates", "avg_us");
+        for (int i = 0; i <= STATS_MAX_DEPTH; i++) {
+            depth_stats_t *d = &stats->depth[i];
+            if (!d->nodes && !d->queries) continue;
+            fprintf(f, "%4d%c %8zu %12.1f %12zu %8zu %10zu %14.1f %10.1f\n",
+                i, i == STATS_MAX_DEPTH ? '+' : ' ', d->nodes,
+                d->nodes ? (double)d->subtree_records / d->nodes : 0.0,
+                d->max_subtree, d->queries, d->mismatches,
+                d->mismatches ? (double)d->candidates / d->mismatches : 0.0,
+                d->queries ? (double)d->usec / d->queries : 0.0);
+        }
+    }
+
+    fprintf(f, "queries %zu, total %ld us", stats->queries, stats->usec);
+    if (stats->available) fprintf(f, ", exact %zu", stats->exact);
+    if (stats->budget.max_candidates || stats->budget.max_usec) {
+        fprintf(f, ", approximate %zu (budget %d candidates, %ld us; 0 is none)",
+            stats->approximate, stats->budget.max_candidates,
+            stats->budget.max_usec);
+    }
+    fputs("\nmost expensive queries:\n", f);
+    for (int i = 0; i < stats->top_count; i++) {
+        query_cost_t *c = &stats->top[i];
+        fprintf(f, "%8ld us b%d n%d s%d", c->usec, c->bit_cmps,
+            c->node_cmps, c->str_cmps);
+        if (stats->available && c->mismatch_byte < 0) {
+            fprintf(f, " depth %d exact", c->depth);
+        } else if (stats->available) {
+            fprintf(f, " depth %d mismatch byte %d candidates %zu", c->depth,
+                c->mismatch_byte, c->candidates);
+        }
+        fprintf(f, "%s  %s\n", c->approximate ? " approximate" : "", c->key);
+    }
+}
+
+
+/* Frees the keys kept for the most expensive queries. */
+void free_tree_stats(tree_stats_t *stats) {
+    for (int i = 0; i < stats->top_count; i++) {
+        free(stats->top[i].key);
+    }
+    stats->top_count = 0;
+}
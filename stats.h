@@ -0,0 +1,75 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+#include <stdio.h>
+#include <stddef.h>
+#include "tree.h"
+#include "result.h"
+
+
+#define STATS_MAX_DEPTH 128  // deeper nodes are counted in the last row
+#define STATS_LOG_BUCKETS 32 // power-of-two buckets: 0, 1, 2-3, 4-7, ...
+#define STATS_TOP_QUERIES 10 // most expensive queries kept for the report
+
+
+// type definition for one expensive query and where its search stopped
+typedef struct {
+    char *key;
+    long usec;
+    int bit_cmps;
+    int node_cmps;
+    int str_cmps;
+    int depth;         // depth of the exact or mismatch node, 0 if none
+    int mismatch_byte; // key byte of the first mismatching bit, -1 if exact
+    size_t candidates; // records in the mismatch node's subtree
+    int approximate;
+} query_cost_t;
+
+// type definition for per-depth node shape and query costs
+typedef struct {
+    size_t nodes;
+    size_t subtree_records; // summed over nodes at this depth
+    size_t max_subtree;
+    size_t mismatches;      // queries whose closest match started here
+    size_t candidates;      // summed over those queries
+    long usec;              // summed over all queries ending here
+    size_t queries;
+} depth_stats_t;
+
+// type definition for the tree_stats report
+typedef struct {
+    int available;  // 0 if the index has no Patricia tree to inspect
+    size_t nodes;
+    size_t record_nodes;
+    int max_depth;
+    depth_stats_t depth[STATS_MAX_DEPTH + 1];
+    size_t prefix_hist[STATS_LOG_BUCKETS];  // nodes by prefix length in bits
+    size_t records_hist[STATS_LOG_BUCKETS]; // record nodes by record count
+    size_t queries;
+    size_t exact;
+    size_t approximate;     // queries whose closest match hit the budget
+    search_budget_t budget; // budget the queries ran with
+    long usec;
+    query_cost_t top[STATS_TOP_QUERIES];    // most expensive first
+    int top_count;
+} tree_stats_t;
+
+
+/* Walks the dictionary's Patricia tree (or every shard's) and fills the
+ * depth, prefix length, records per node and subtree size figures.
+ */
+void stats_collect_tree(tree_stats_t *stats, tree_dict_t *dict);
+
+/* Adds one searched query: its time, counters and the depth and key byte
+ * where its descent stopped, charged to that depth.
+ */
+void stats_record_query(tree_stats_t *stats, tree_dict_t *dict, char *key,
+    result_t *result, long usec);
+
+/* Prints the tree shape and query cost report. */
+void print_tree_stats(FILE *f, tree_stats_t *stats);
+
+/* Frees the keys kept for the most expensive queries. */
+void free_tree_stats(tree_stats_t *stats);
+
+
+#endif
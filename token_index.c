@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include "token_index.h"
+#include "hash.h"
+
+
+/* Helper to upper-case a copy of str and split it in place at spaces into
+ * at most max tokens. Returns the copy, which the tokens point into.
+ */
+static char *split_tokens(char *str, char **tokens, int max, int *count) {
+    char *copy = strdup(str);
+    assert(copy);
+    *count = 0;
+    for (char *p = copy; *p; ) {
+        while (*p == ' ') *p++ = '\0';
+        if (!*p) break;
+        if (*count < max) tokens[(*count)++] = p;
+        while (*p && *p != ' ') {
+            *p = toupper((unsigned char)*p);
+            p++;
+        }
+    }
+    return copy;
+}
+
+
+/* Returns token's slot: its entry if present, else the empty slot ending
+ * its probe sequence.
+ */
+static token_entry_t *probe(token_index_t *index, char *token, uint32_t h) {
+    size_t mask = index->cap - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        token_entry_t *entry = &index->entries[i];
+        if (!entry->token) return entry;
+        if (entry->hash == h && strcmp(entry->token, token) == 0) return entry;
+    }
+}
+
+
+/* Helper to double the token table and reinsert every entry. */
+static void grow_table(token_index_t *index) {
+    token_entry_t *old = index->entries;
+    size_t old_cap = index->cap;
+    index->cap *= 2;
+    index->entries = (token_entry_t *)calloc(index->cap, sizeof(token_entry_t));
+    assert(index->entries);
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].token) *probe(index, old[i].token, old[i].hash) = old[i];
+    }
+    free(old);
+}
+
+
+/* Helper to append key id to token's postings, once per key. */
+static void add_posting(token_index_t *index, char *token, uint32_t id) {
+    if ((index->tokens + 1) * 2 > index->cap) grow_table(index);
+    uint32_t h = hash_string(token);
+    token_entry_t *entry = probe(index, token, h);
+    if (!entry->token) {
+        entry->token = strdup(token);
+        assert(entry->token);
+        entry->hash = h;
+        index->tokens++;
+    } else if (entry->last == id) {
+        return;
+    }
+
+    if (entry->count % TOKEN_SKIP_EVERY == 0) {
+        uint32_t block = entry->count / TOKEN_SKIP_EVERY;
+        entry->skips = (token_skip_t *)realloc(entry->skips,
+            (block + 1) * sizeof(token_skip_t));
+        assert(entry->skips);
+        entry->skips[block].prev = entry->count ? entry->last : 0;
+        entry->skips[block].offset = entry->len;
+    }
+
+    // at most 5 bytes of 7 bits each for a 32-bit gap
+    if (entry->len + 5 > entry->cap) {
+        entry->cap = entry->cap ? entry->cap * 2 : 8;
+        entry->postings = (uint8_t *)realloc(entry->postings, entry->cap);
+        assert(entry->postings);
+    }
+    uint32_t gap = entry->count ? id - entry->last : id;
+    while (gap >= 0x80) {
+        entry->postings[entry->len++] = (gap & 0x7f) | 0x80;
+        gap >>= 7;
+    }
+    entry->postings[entry->len++] = gap;
+    entry->last = id;
+    entry->count++;
+}
+
+
+/* Helper to decode the next id of a postings list at *pos after prev. */
+static uint32_t next_posting(uint8_t *postings, size_t *pos, uint32_t prev) {
+    uint32_t gap = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t byte = postings[(*pos)++];
+        gap |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return prev + gap;
+}
+
+
+/* Helper to move a cursor of a postings list to its first id not below
+ * target, jumping over whole blocks by their skip entries. The cursor has
+ * read *read ids, the last being *id, and reads on from byte *pos.
+ * Returns 0 if every id is below target.
+ */
+static int seek_posting(token_entry_t *list, uint32_t target, uint32_t *read,
+        size_t *pos, uint32_t *id) {
+    if (*read && *id >= target) return 1;
+
+    uint32_t block = *read / TOKEN_SKIP_EVERY;
+    uint32_t blocks = (list->count + TOKEN_SKIP_EVERY - 1) / TOKEN_SKIP_EVERY;
+    while (block + 1 < blocks && list->skips[block + 1].prev < target) block++;
+    if (block * TOKEN_SKIP_EVERY > *read) {
+        *read = block * TOKEN_SKIP_EVERY;
+        *pos = list->skips[block].offset;
+        *id = list->skips[block].prev;
+    }
+
+    while (*read < list->count) {
+        *id = next_posting(list->postings, pos, *id);
+        (*read)++;
+        if (*id >= target) return 1;
+    }
+    return 0;
+}
+
+
+/* Helper qsort comparator ordering record pointers by key. */
+static int compare_record_keys(const void *a, const void *b) {
+    return strcmp(get_record_key(*(record_t **)a), get_record_key(*(record_t **)b));
+}
+
+
+/* Builds the index from a finished dictionary of any index type. Key ids
+ * follow key order, so postings and ties between candidates are
+ * alphabetical.
+ */
+token_index_t *token_index_build(tree_dict_t *dict) {
+    token_index_t *index = (token_index_t *)malloc(sizeof(*index));
+    assert(index);
+    index->cap = 1024;
+    index->tokens = 0;
+    index->entries = (token_entry_t *)calloc(index->cap, sizeof(token_entry_t));
+    index->keys = (token_key_t *)malloc((dict->size + 1) * sizeof(token_key_t));
+    index->records = (record_t **)malloc((dict->size + 1) * sizeof(record_t *));
+    assert(index->entries && index->keys && index->records);
+    index->key_count = 0;
+    index->record_count = 0;
+
+    // every record, in key order whatever the backend or sharding
+    result_t all, found;
+    initialise_result(&all, dict->size);
+    initialise_result(&found, dict->size);
+    dict_prefix_search(dict, "", &all);
+    qsort(all.matches, all.match_count, sizeof(record_t *), compare_record_keys);
+
+    for (int i = 0; i < all.match_count; i++) {
+        char *key = get_record_key(all.matches[i]);
+        if (index->key_count
+                && strcmp(index->keys[index->key_count - 1].key, key) == 0) {
+            continue;
+        }
+
+        // the tree's own answer fixes record order
+        found.match_count = 0;
+        dict_exact_search(dict, key, &found);
+        assert(found.match_count > 0);
+
+        uint32_t id = index->key_count++;
+        token_key_t *entry = &index->keys[id];
+        entry->key = get_record_key(found.matches[0]);
+        entry->first = index->record_count;
+        entry->count = found.match_count;
+        memcpy(index->records + index->record_count, found.matches,
+            found.match_count * sizeof(record_t *));
+        index->record_count += found.match_count;
+
+        char *tokens[TOKEN_MAX_QUERY];
+        int count;
+        char *copy = split_tokens(key, tokens, TOKEN_MAX_QUERY, &count);
+        for (int t = 0; t < count; t++) add_posting(index, tokens[t], id);
+        free(copy);
+    }
+
+    free_result(&all);
+    free_result(&found);
+    return index;
+}
+
+
+/* Widens the closest match for a key that is not in the dictionary:
+ * intersects the postings of the query's tokens, smallest first, skipping
+ * tokens no key has. If that leaves between 1 and TOKEN_MAX_CANDIDATES
+ * keys, their records join the index's own closest match, held in result
+ * from init_count, and all are ranked by edit distance again, so the
+ * token candidates can only improve the pick. One node comparison is
+ * counted per postings list read and 1 is returned. Returns 0 and leaves
+ * result untouched if the intersection is empty or too large.
+ */
+int token_index_search(token_index_t *index, char *key, result_t *result,
+        int init_count) {
+    char *tokens[TOKEN_MAX_QUERY];
+    token_entry_t *lists[TOKEN_MAX_QUERY];
+    int count, list_count = 0;
+    char *copy = split_tokens(key, tokens, TOKEN_MAX_QUERY, &count);
+
+    // known tokens, shortest postings first by insertion sort
+    for (int t = 0; t < count; t++) {
+        token_entry_t *entry = probe(index, tokens[t], hash_string(tokens[t]));
+        if (!entry->token) continue;
+        int j = list_count++;
+        while (j > 0 && lists[j - 1]->count > entry->count) {
+            lists[j] = lists[j - 1];
+            j--;
+        }
+        lists[j] = entry;
+    }
+    free(copy);
+    if (!list_count) return 0;
+
+    // the smallest list seeds the candidates, later lists only filter them
+    uint32_t *ids = (uint32_t *)malloc(lists[0]->count * sizeof(uint32_t));
+    assert(ids);
+    size_t pos = 0;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < lists[0]->count; i++) {
+        prev = ids[i] = next_posting(lists[0]->postings, &pos, prev);
+    }
+    uint32_t matched = lists[0]->count;
+    int lists_read = 1;
+
+    for (int l = 1; l < list_count && matched; l++) {
+        uint32_t kept = 0, read = 0, id = 0;
+        pos = 0;
+        for (uint32_t i = 0; i < matched; i++) {
+            if (!seek_posting(lists[l], ids[i], &read, &pos, &id)) break;
+            if (id == ids[i]) ids[kept++] = ids[i];
+        }
+        matched = kept;
+        lists_read++;
+    }
+
+    if (!matched || matched > TOKEN_MAX_CANDIDATES) {
+        free(ids);
+        return 0;
+    }
+
+    // the index's pick is already in result, so its key is not added twice
+    char *picked = result->match_count > init_count
+        ? get_record_key(result->matches[init_count]) : NULL;
+    for (uint32_t i = 0; i < matched; i++) {
+        token_key_t *entry = &index->keys[ids[i]];
+        if (picked && strcmp(entry->key, picked) == 0) continue;
+        memcpy(result->matches + result->match_count, index->records + entry->first,
+            entry->count * sizeof(record_t *));
+        result->match_count += entry->count;
+    }
+    result->node_cmps += lists_read;
+    free(ids);
+
+    select_closest(result, key, init_count);
+    return 1;
+}
+
+
+/* Adds the index's memory use to stats. */
+void token_index_memory_stats(token_index_t *index, tree_mem_stats_t *stats) {
+    if (!index) return;
+    stats->node_bytes += sizeof(*index) + index->cap * sizeof(token_entry_t)
+        + index->key_count * sizeof(token_key_t);
+    for (size_t i = 0; i < index->cap; i++) {
+        token_entry_t *entry = &index->entries[i];
+        if (entry->token) {
+            stats->prefix_bytes += strlen(entry->token) + 1;
+            stats->link_bytes += entry->cap
+                + (entry->count + TOKEN_SKIP_EVERY - 1) / TOKEN_SKIP_EVERY
+                * sizeof(token_skip_t);
+        }
+    }
+    stats->link_bytes += index->record_count * sizeof(record_t *);
+}
+
+
+/* Frees the index, not the records. */
+void free_token_index(token_index_t *index) {
+    if (!index) return;
+    for (size_t i = 0; i < index->cap; i++) {
+        free(index->entries[i].token);
+        free(index->entries[i].postings);
+        free(index->entries[i].skips);
+    }
+    free(index->entries);
+    free(index->keys);
+    free(index->records);
+    free(index);
+}
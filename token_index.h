@@ -0,0 +1,77 @@
+#ifndef _TOKEN_INDEX_H_
+#define _TOKEN_INDEX_H_
+#include <stdint.h>
+#include <stddef.h>
+#include "tree.h"
+#include "record.h"
+#include "result.h"
+
+
+#define TOKEN_MAX_CANDIDATES 256 // larger intersections are not ranked
+#define TOKEN_MAX_QUERY 64       // query tokens looked up, the rest are ignored
+#define TOKEN_SKIP_EVERY 64      // postings per skip entry
+
+
+// one distinct key and where its records sit in the index's record array
+typedef struct {
+    char *key;       // the records' own key string
+    uint32_t first;
+    uint32_t count;
+} token_key_t;
+
+// where a block of TOKEN_SKIP_EVERY postings starts, to seek past blocks
+typedef struct {
+    uint32_t prev;   // id before the block's first, which its first gap follows
+    uint32_t offset; // byte offset of the block's first gap
+} token_skip_t;
+
+// one distinct token and the ids of the keys containing it
+typedef struct {
+    char *token;     // upper-cased copy, NULL when the slot is empty
+    uint32_t hash;
+    uint32_t count;  // key ids in the postings
+    uint32_t last;   // last key id added, to drop repeats while building
+    uint8_t *postings; // ascending ids as varint gaps from the previous id
+    size_t len;
+    size_t cap;
+    token_skip_t *skips; // one per block of postings
+} token_entry_t;
+
+// inverted index from the space separated tokens of every key to the keys
+typedef struct token_index {
+    token_entry_t *entries;
+    size_t cap;         // power of two, at least twice the token count
+    size_t tokens;
+    token_key_t *keys;  // in increasing key order, indexed by key id
+    size_t key_count;
+    record_t **records; // grouped by key, in the tree's exact match order
+    size_t record_count;
+} token_index_t;
+
+
+/* Builds the index from a finished dictionary of any index type. Key ids
+ * follow key order, so postings and ties between candidates are
+ * alphabetical.
+ */
+token_index_t *token_index_build(tree_dict_t *dict);
+
+/* Widens the closest match for a key that is not in the dictionary:
+ * intersects the postings of the query's tokens, smallest first, skipping
+ * tokens no key has. If that leaves between 1 and TOKEN_MAX_CANDIDATES
+ * keys, their records join the index's own closest match, held in result
+ * from init_count, and all are ranked by edit distance again, so the
+ * token candidates can only improve the pick. One node comparison is
+ * counted per postings list read and 1 is returned. Returns 0 and leaves
+ * result untouched if the intersection is empty or too large.
+ */
+int token_index_search(token_index_t *index, char *key, result_t *result,
+    int init_count);
+
+/* Adds the index's memory use to stats. */
+void token_index_memory_stats(token_index_t *index, tree_mem_stats_t *stats);
+
+/* Frees the index, not the records. */
+void free_token_index(token_index_t *index);
+
+
+#endif
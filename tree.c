@@ -5,15 +5,35 @@
 #include "tree.h"
 #include "bit.h"
 #include "edit_dist.h"
+#include "art.h"
+#include "compact.h"
+#include "shard.h"
+#include "exact_hash.h"
+#include "token_index.h"
 
 
-/* Creates dictionary, and store NUM_FIELDS of header names read. */
-tree_dict_t *create_tree_dict(char *headers[NUM_FIELDS]) {
+/* Creates dictionary with the chosen index backend,
+ * and store NUM_FIELDS of header names read.
+ */
+tree_dict_t *create_tree_dict(char *headers[NUM_FIELDS], int index_type) {
     tree_dict_t *dict = (tree_dict_t*)malloc(sizeof(*dict));
     assert(dict);
     
     dict->root = NULL;
     dict->size = 0;
+    dict->store = create_record_store();
+    dict->index_type = index_type;
+    dict->art = NULL;
+    dict->compact = NULL;
+    dict->num_shards = 0;
+    dict->shard_by = SHARD_BY_PREFIX;
+    dict->shards = NULL;
+    dict->shard_max_size = 0;
+    dict->exact = NULL;
+    dict->tokens = NULL;
+    if (index_type == INDEX_ART) {
+        dict->art = create_art_tree();
+    }
     
     for (int i = 0; i < NUM_FIELDS; i++) {
         dict->headers[i] = headers[i];
@@ -51,6 +71,15 @@ void add_record(tree_node_t *node, record_t *record) {
 }
 
 
+/* Finishes building, converting to the compact layout if selected. */
+void tree_finalise(tree_dict_t *dict) {
+    if (dict->index_type == INDEX_COMPACT && !dict->compact) {
+        dict->compact = compact_tree_build(dict->root);
+        dict->root = NULL;
+    }
+}
+
+
 /* Helper to get key's total number of bits. */
 int get_total_bits(char *key) {
     return (strlen(key) + 1) * BITS_PER_BYTE;
@@ -83,8 +112,12 @@ int compare_prefix_bits(char *key, int start_bit, int key_total_bits,
 
 /* Acessed by main driver for insertion into tree dict. */
 void insert_tree(tree_dict_t *tree, char *key, record_t *record) {
-    int total_bits = get_total_bits(key);
-    tree->root = recursive_insert(tree->root, key, total_bits, START_BIT, record);
+    if (tree->index_type == INDEX_ART) {
+        art_insert(tree->art, key, record);
+    } else {
+        int total_bits = get_total_bits(key);
+        tree->root = recursive_insert(tree->root, key, total_bits, START_BIT, record);
+    }
     tree->size++;
 }
 
@@ -241,6 +274,8 @@ tree_node_t *recursive_exact_search(tree_node_t *node, char *key, int total_bits
 /* Post traversal helper to collect all descendant records. */
 void collect_subtree_records(tree_node_t *node, result_t *result) {
     if (!node) return;
+    // keep what was gathered once a time budget runs out
+    if (result->match_count && result_out_of_time(result)) return;
     for (node_rec_t *nrec = node->head; nrec; nrec = nrec->next) {
         result->matches[result->match_count++] = nrec->rec;
     }
@@ -251,52 +286,107 @@ void collect_subtree_records(tree_node_t *node, result_t *result) {
 
 /* Helper to extract EZI_ADD key from record. */
 char *get_record_key(record_t *record) {
-    return record->fields[EZI_ADD_INDEX];
+    return record_field(record, EZI_ADD_INDEX);
 }
 
 
-/* Helper to check if candidate key has already been tested. */
-int already_tested(result_t *result, int init_count, int i, char *candidate) {
-    for (int j = init_count; j < i; j++) {
-        if (strcmp(get_record_key(result->matches[j]), candidate) == 0) {
-            return 1;
-        }
+/* Helper to order candidates by increasing lower bound, counting sort
+ * since bounds are small, so the setup stays linear in the candidates.
+ */
+static void sort_by_bound(candidate_t *cands, int count) {
+    int max_bound = 0;
+    for (int i = 0; i < count; i++) {
+        if (cands[i].bound > max_bound) max_bound = cands[i].bound;
     }
-    return 0;
+    int *starts = (int *)calloc(max_bound + 2, sizeof(int));
+    candidate_t *sorted = (candidate_t *)malloc(count * sizeof(candidate_t));
+    assert(starts && sorted);
+
+    for (int i = 0; i < count; i++) starts[cands[i].bound + 1]++;
+    for (int b = 1; b <= max_bound + 1; b++) starts[b] += starts[b - 1];
+    for (int i = 0; i < count; i++) sorted[starts[cands[i].bound]++] = cands[i];
+
+    memcpy(cands, sorted, count * sizeof(candidate_t));
+    free(sorted);
+    free(starts);
 }
 
 
 /* Choose best candidate key if it has 
- * minimum edit distance and alphabetically earliest
+ * minimum edit distance and alphabetically earliest.
+ * Distinct candidate keys are visited by increasing histogram lower bound
+ * and scored a batch at a time; once a bound exceeds the best distance
+ * found, no remaining candidate can win and the rest are skipped.
+ * Scored candidates count against the result's budget, shared with any
+ * earlier ranking of the same query. If it runs out first, the best key
+ * so far is returned and the result is marked approximate.
  */
 char *find_best_key(result_t *result, char *key, int init_count, int cand_count) {
+    candidate_t *cands = (candidate_t *)malloc(cand_count * sizeof(candidate_t));
+    assert(cands);
+    char_hist_t key_hist;
+    charHistogram(key, &key_hist);
+
+    int distinct = 0;
+    for (int i = init_count; i < init_count + cand_count; i ++) {
+        record_t *rec = result->matches[i];
+        char *candidate = get_record_key(rec);
+        // a key's records are collected together, so skip repeats of the
+        // last key; any other repeat only scores the same distance again
+        if (distinct && strcmp(cands[distinct - 1].key, candidate) == 0) continue;
+        cands[distinct].key = candidate;
+        cands[distinct++].bound = histogramBound(&key_hist, &rec->key_hist);
+    }
+    sort_by_bound(cands, distinct);
+
     char *best_key = NULL;
     int best_dist = 0;
+    int key_len = strlen(key);
+    for (int start = 0; start < distinct; ) {
+        // a candidate whose bound equals the best may still tie and win
+        if (best_key && cands[start].bound > best_dist) break;
+        if (best_key && result_budget_spent(result)) {
+            result->approximate = 1;
+            break;
+        }
 
-    for (int i = init_count; i < init_count + cand_count; i ++) {
-        char *candidate = get_record_key(result->matches[i]);
-        // skip if already seen and tested this key
-        if (already_tested(result, init_count, i, candidate)) continue;
-
-        int dist = editDistance(key, candidate, strlen(key), strlen(candidate));
-        // update best candidate if min edit dist and alphabetically first
-        if (!best_key || dist < best_dist || 
-            (dist == best_dist && strcmp(candidate, best_key) < 0)) {
-            best_key = candidate;
-            best_dist = dist;
+        // a ranking always scores one candidate, so it has a best key
+        int limit = EDIT_BATCH_LANES;
+        int left = result->budget.max_candidates - result->scored;
+        if (result->budget.max_candidates && left < limit) {
+            limit = left > 0 ? left : 1;
         }
+        char *batch[EDIT_BATCH_LANES];
+        int lens[EDIT_BATCH_LANES], dists[EDIT_BATCH_LANES];
+        int n = 0;
+        while (n < limit && start + n < distinct
+                && (!best_key || cands[start + n].bound <= best_dist)) {
+            batch[n] = cands[start + n].key;
+            lens[n] = strlen(batch[n]);
+            n++;
+        }
+        editDistanceBatch(key, key_len, batch, lens, n, dists);
+        result->scored += n;
+
+        for (int i = 0; i < n; i++) {
+            // update best candidate if min edit dist and alphabetically first
+            if (!best_key || dists[i] < best_dist || 
+                (dists[i] == best_dist && strcmp(batch[i], best_key) < 0)) {
+                best_key = batch[i];
+                best_dist = dists[i];
+            }
+        }
+        start += n;
     }
+    free(cands);
     return best_key;
 }
 
 
-/* Does closest-match search to find nearest key after mismatch. */
-void search_closest(tree_node_t *last_match, char *key, result_t *result) {
-    if (!last_match) return;
-    
-    // Collect all descendants as possible candidates
-    int init_count = result->match_count;
-    collect_subtree_records(last_match, result);
+/* Keeps only the records of the best candidate key among those
+ * collected into result from init_count onwards.
+ */
+void select_closest(result_t *result, char *key, int init_count) {
     int cand_count = result->match_count - init_count;
     if (!cand_count) {
         result->match_count = init_count;
@@ -318,6 +408,182 @@ void search_closest(tree_node_t *last_match, char *key, result_t *result) {
 }
 
 
+/* Does closest-match search to find nearest key after mismatch. */
+void search_closest(tree_node_t *last_match, char *key, result_t *result) {
+    if (!last_match) return;
+    
+    // Collect all descendants as possible candidates
+    int init_count = result->match_count;
+    collect_subtree_records(last_match, result);
+    select_closest(result, key, init_count);
+}
+
+
+/* Helper to search the dictionary's index for key, falling back to
+ * closest match. Returns 1 if key was found.
+ */
+static int index_search(tree_dict_t *dict, char *key, result_t *result) {
+    if (dict->num_shards) return shard_search(dict, key, result);
+    if (dict->index_type == INDEX_ART) {
+        art_node_t *mismatch_node = NULL;
+        art_leaf_t *found = art_exact_search(dict->art, key, result, &mismatch_node);
+        if (!found && mismatch_node) {
+            art_search_closest(mismatch_node, key, result);
+        }
+        return found != NULL;
+    }
+    if (dict->index_type == INDEX_COMPACT && dict->compact) {
+        uint32_t mismatch_idx = COMPACT_NONE;
+        uint32_t found = compact_exact_search(dict->compact, key, result, &mismatch_idx);
+        if (found == COMPACT_NONE && mismatch_idx != COMPACT_NONE) {
+            compact_search_closest(dict->compact, mismatch_idx, key, result);
+        }
+        return found != COMPACT_NONE;
+    }
+
+    // search the tree and try to find exact match
+    tree_node_t *mismatch_node = NULL;
+    tree_node_t *found_node = exact_search(dict, key, result, &mismatch_node);
+
+    // if not exact match, find closest match
+    if (!found_node && mismatch_node) {
+        search_closest(mismatch_node, key, result);
+    }
+    return found_node != NULL;
+}
+
+
+/* Searches the dictionary's index for key, falling back to closest match.
+ * A miss is widened by the token index, if there is one.
+ */
+void dict_search(tree_dict_t *dict, char *key, result_t *result) {
+    if (dict->exact && exact_hash_search(dict->exact, key, result)) return;
+    int init_count = result->match_count;
+    if (index_search(dict, key, result)) return;
+    if (dict->tokens) token_index_search(dict->tokens, key, result, init_count);
+}
+
+
+/* Searches the dictionary's index for key only, without closest match.
+ * Returns 1 if found.
+ */
+int dict_exact_search(tree_dict_t *dict, char *key, result_t *result) {
+    if (dict->exact) return exact_hash_search(dict->exact, key, result);
+    if (dict->num_shards) {
+        return dict_exact_search(dict->shards[shard_of(dict, key)], key, result);
+    }
+    if (dict->index_type == INDEX_ART) {
+        art_node_t *mismatch_node = NULL;
+        return art_exact_search(dict->art, key, result, &mismatch_node) != NULL;
+    }
+    if (dict->index_type == INDEX_COMPACT && dict->compact) {
+        uint32_t mismatch_idx = COMPACT_NONE;
+        return compact_exact_search(dict->compact, key, result, &mismatch_idx)
+            != COMPACT_NONE;
+    }
+    tree_node_t *mismatch_node = NULL;
+    return exact_search(dict, key, result, &mismatch_node) != NULL;
+}
+
+
+/* Descends the tree along prefix, returns the node whose subtree holds
+ * every key starting with prefix, or NULL if none.
+ */
+tree_node_t *prefix_search(tree_node_t *node, char *prefix, result_t *result) {
+    // the prefix has no terminating byte, so only its characters are matched
+    int total_bits = strlen(prefix) * BITS_PER_BYTE;
+    int curr_bit = START_BIT;
+
+    while (node) {
+        result->node_cmps++;
+        int match_count = compare_prefix_bits(prefix, curr_bit, total_bits,
+            node->prefix, node->prefix_bits);
+        result->bit_cmps += match_count;
+
+        // prefix used up inside or at the end of this node
+        if (match_count == total_bits - curr_bit) return node;
+        if (match_count < node->prefix_bits) {
+            result->bit_cmps++;
+            return NULL;
+        }
+
+        curr_bit += node->prefix_bits;
+        node = getBit(prefix, curr_bit) == 0 ? node->left : node->right;
+    }
+    return NULL;
+}
+
+
+/* Collects records of every key starting with prefix into result. */
+void dict_prefix_search(tree_dict_t *dict, char *prefix, result_t *result) {
+    if (dict->num_shards) {
+        // keys sharing a prefix can live in any shard
+        for (int s = 0; s < dict->num_shards; s++) {
+            dict_prefix_search(dict->shards[s], prefix, result);
+        }
+        return;
+    }
+    if (dict->index_type == INDEX_ART) {
+        art_prefix_search(dict->art, prefix, result);
+    } else if (dict->index_type == INDEX_COMPACT && dict->compact) {
+        compact_prefix_search(dict->compact, prefix, result);
+    } else {
+        collect_subtree_records(prefix_search(dict->root, prefix, result), result);
+    }
+    result->str_cmps++;
+}
+
+
+/* Helper adding a pointer subtree's memory use to stats. */
+static void node_memory_stats(tree_node_t *node, tree_mem_stats_t *stats) {
+    if (!node) return;
+    stats->node_count++;
+    stats->node_bytes += sizeof(*node);
+    stats->prefix_bytes += (node->prefix_bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+    for (node_rec_t *nrec = node->head; nrec; nrec = nrec->next) {
+        stats->link_bytes += sizeof(*nrec);
+        stats->record_count++;
+        stats->field_bytes += record_memory_bytes(nrec->rec);
+    }
+    node_memory_stats(node->left, stats);
+    node_memory_stats(node->right, stats);
+}
+
+
+/* Reports bytes used by nodes, prefixes, record links and record fields. */
+void tree_memory_stats(tree_dict_t *dict, tree_mem_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!dict) return;
+    for (int s = 0; s < dict->num_shards; s++) {
+        tree_mem_stats_t shard_stats;
+        tree_memory_stats(dict->shards[s], &shard_stats);
+        stats->node_count += shard_stats.node_count;
+        stats->node_bytes += shard_stats.node_bytes;
+        stats->prefix_bytes += shard_stats.prefix_bytes;
+        stats->link_bytes += shard_stats.link_bytes;
+        stats->record_count += shard_stats.record_count;
+        stats->field_bytes += shard_stats.field_bytes;
+    }
+    node_memory_stats(dict->root, stats);
+    stats->field_bytes += store_memory_bytes(dict->store);
+    art_memory_stats(dict->art, stats);
+    compact_memory_stats(dict->compact, stats);
+    exact_hash_memory_stats(dict->exact, stats);
+    token_index_memory_stats(dict->tokens, stats);
+}
+
+
+/* Prints memory stats as one summary line. */
+void print_memory_stats(FILE *f, tree_mem_stats_t *stats) {
+    size_t total = stats->node_bytes + stats->prefix_bytes
+        + stats->link_bytes + stats->field_bytes;
+    fprintf(f, "memory: nodes %zu (%zu B) prefixes %zu B links %zu B "
+        "records %zu (%zu B) total %zu B\n",
+        stats->node_count, stats->node_bytes, stats->prefix_bytes,
+        stats->link_bytes, stats->record_count, stats->field_bytes, total);
+}
+
+
 /* Frees a subtree recursively. */
 void free_node(tree_node_t *node) {
     if (!node) return;
@@ -342,6 +608,15 @@ void free_node(tree_node_t *node) {
 void free_tree(tree_dict_t *tree) {
     assert(tree);
     free_node(tree->root);
+    free_art_tree(tree->art);
+    free_compact_tree(tree->compact);
+    free_exact_hash(tree->exact);
+    free_token_index(tree->tokens);
+    for (int s = 0; s < tree->num_shards; s++) {
+        free_tree(tree->shards[s]);
+    }
+    free(tree->shards);
+    free_record_store(tree->store);
     
     // Free headers
     for (int i = 0; i < NUM_FIELDS; i++) {
@@ -6,6 +6,11 @@
 
 #define START_BIT 0 // starting position of current bit
 
+// Index backends selectable for a dictionary.
+#define INDEX_PATRICIA 0 // binary Patricia tree, one bit per branch
+#define INDEX_ART 1      // adaptive radix tree, one byte per branch
+#define INDEX_COMPACT 2  // Patricia tree frozen into flat arrays after build
+
 
 // Type definitions for tree dictionary.
 typedef struct node_rec node_rec_t;
@@ -30,12 +35,40 @@ struct tree_dict {
     tree_node_t *root;
     char *headers[NUM_FIELDS];
     size_t size;
+    record_store_t *store; // column layout shared by the dictionary's records
+    int index_type;
+    struct art_tree *art; // used instead of root when index_type is INDEX_ART
+    struct compact_tree *compact; // replaces root after build for INDEX_COMPACT
+    int num_shards;       // 0 unless split into independent shard trees
+    int shard_by;
+    tree_dict_t **shards;
+    size_t shard_max_size; // records in the largest shard
+    struct exact_hash *exact; // optional exact-match table in front of the index
+    struct token_index *tokens; // optional token postings for closest match
 };
 
+// type definition for bytes held by a dictionary, by category
+typedef struct {
+    size_t node_count;
+    size_t node_bytes;   // index nodes (and leaves)
+    size_t prefix_bytes; // stems/prefixes stored outside nodes
+    size_t link_bytes;   // per-record links from nodes to records
+    size_t record_count;
+    size_t field_bytes;  // record structs plus their field strings
+} tree_mem_stats_t;
+
+// distinct closest-match candidate key with its edit distance lower bound
+typedef struct {
+    char *key;
+    int bound;
+} candidate_t;
+
 
 /* Tree and node creation logic: */
-/* Creates dictionary, and store NUM_FIELDS of header names read. */
-tree_dict_t *create_tree_dict(char *headers[NUM_FIELDS]);
+/* Creates dictionary with the chosen index backend,
+ * and store NUM_FIELDS of header names read.
+ */
+tree_dict_t *create_tree_dict(char *headers[NUM_FIELDS], int index_type);
 
 /* Create a new node with given prefix. */
 tree_node_t *create_node(char *prefix, int prefix_bits);
@@ -43,6 +76,9 @@ tree_node_t *create_node(char *prefix, int prefix_bits);
 /* Add a record to the node and store to a linked list. */
 void add_record(tree_node_t *node, record_t *record);
 
+/* Finishes building, converting to the compact layout if selected. */
+void tree_finalise(tree_dict_t *dict);
+
 
 /* Insertion logic: */
 /* Helper to get key's total number of bits. */
@@ -88,17 +124,53 @@ void collect_subtree_records(tree_node_t *node, result_t *result);
 /* Helper to extract EZI_ADD key from record. */
 char *get_record_key(record_t *record);
 
-/* Helper to check if candidate key has already been tested. */
-int already_tested(result_t *result, int start, int i, char *candidate);
-
 /* Choose best candidate key if it has 
- * minimum edit distance and alphabetically earliest
+ * minimum edit distance and alphabetically earliest.
+ * Distinct candidate keys are visited by increasing histogram lower bound
+ * and scored a batch at a time; once a bound exceeds the best distance
+ * found, no remaining candidate can win and the rest are skipped.
+ * Scored candidates count against the result's budget, shared with any
+ * earlier ranking of the same query. If it runs out first, the best key
+ * so far is returned and the result is marked approximate.
  */
 char *find_best_key(result_t *res, char *query, int start, int cand_total);
 
+/* Keeps only the records of the best candidate key among those
+ * collected into result from init_count onwards.
+ */
+void select_closest(result_t *result, char *key, int init_count);
+
 /* Does closest-match search to find nearest key after mismatch. */
 void search_closest(tree_node_t *last_match, char *key, result_t *result);
 
+/* Searches the dictionary's index for key, falling back to closest match.
+ * A miss is widened by the token index, if there is one.
+ */
+void dict_search(tree_dict_t *dict, char *key, result_t *result);
+
+/* Searches the dictionary's index for key only, without closest match.
+ * Returns 1 if found.
+ */
+int dict_exact_search(tree_dict_t *dict, char *key, result_t *result);
+
+
+/* Prefix search logic: */
+/* Descends the tree along prefix, returns the node whose subtree holds
+ * every key starting with prefix, or NULL if none.
+ */
+tree_node_t *prefix_search(tree_node_t *node, char *prefix, result_t *result);
+
+/* Collects records of every key starting with prefix into result. */
+void dict_prefix_search(tree_dict_t *dict, char *prefix, result_t *result);
+
+
+/* Memory accounting logic: */
+/* Reports bytes used by nodes, prefixes, record links and record fields. */
+void tree_memory_stats(tree_dict_t *dict, tree_mem_stats_t *stats);
+
+/* Prints memory stats as one summary line. */
+void print_memory_stats(FILE *f, tree_mem_stats_t *stats);
+
 
 /* Free logic: */
 /* Frees a subtree recursively. */